@@ -1,5 +1,7 @@
 
 #include <iostream>
+#include <chrono>
+#include <unordered_map>
 
 #include "tiny_obj_loader.h"
 
@@ -11,6 +13,97 @@
 // materiau par defaut (couleur ambiante, couleur diffuse, couleur speculaire, shininess, tex ambient, tex diffuse, tex specular)
 Material Material::defaultMaterial = { { 0.f, 0.f, 0.f }, { 1.f, 1.f, 1.f }, { 0.f, 0.f, 0.f }, 256.f, 0, 1, 0 };
 
+// Soudure (welding) des sommets en temps lineaire (en moyenne) a la place de la recherche lineaire en O(n^2)
+// 1. une table de hachage indexee par le triplet d'indices tinyobj (position, normale, texcoords)
+//    retrouve immediatement les sommets deja rencontres, c'est le cas le plus frequent en OBJ
+// 2. un nouveau triplet peut malgre tout designer un sommet "proche" d'un sommet existant (cf. Vertex::IsSame)
+//    on range alors les sommets dans une grille de cellules de taille EPSILON indexee par la position.
+//    Deux positions a moins de EPSILON l'une de l'autre sont forcement dans des cellules voisines,
+//    il suffit donc de tester les 27 cellules autour du sommet
+// Le resultat est identique a la recherche lineaire : on retient le plus petit indice qui correspond
+struct VertexWelder
+{
+	struct IndexKey
+	{
+		int32_t v, n, t;
+		bool operator==(const IndexKey& rhs) const { return v == rhs.v && n == rhs.n && t == rhs.t; }
+	};
+	struct CellKey
+	{
+		int64_t x, y, z;
+		bool operator==(const CellKey& rhs) const { return x == rhs.x && y == rhs.y && z == rhs.z; }
+	};
+	struct KeyHash
+	{
+		// combinaison a la boost::hash_combine
+		static inline size_t Combine(size_t seed, uint64_t value) {
+			return seed ^ (size_t(value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+		}
+		size_t operator()(const IndexKey& k) const { return Combine(Combine(Combine(0, uint32_t(k.v)), uint32_t(k.n)), uint32_t(k.t)); }
+		size_t operator()(const CellKey& k) const { return Combine(Combine(Combine(0, k.x), k.y), k.z); }
+	};
+
+	static constexpr uint32_t INVALID = 0xffffffff;
+
+	const Vertex* vertices;		// sommets deja emis (tableau du SubMesh)
+	bool useEpsilon;
+	std::unordered_map<IndexKey, uint32_t, KeyHash> indexMap;
+	std::unordered_map<CellKey, uint32_t, KeyHash> cellHeads;	// premier sommet de chaque cellule
+	std::vector<uint32_t> cellNext;								// liste chainee des sommets d'une meme cellule
+
+	VertexWelder(const Vertex* emitted, size_t capacity, bool epsilon) : vertices(emitted), useEpsilon(epsilon)
+	{
+		indexMap.reserve(capacity);
+		if (useEpsilon) {
+			cellHeads.reserve(capacity);
+			cellNext.reserve(capacity);
+		}
+	}
+
+	static inline CellKey Cell(const vec3& p)
+	{
+		return { (int64_t)floor(double(p.x) / Vertex::EPSILON), (int64_t)floor(double(p.y) / Vertex::EPSILON), (int64_t)floor(double(p.z) / Vertex::EPSILON) };
+	}
+
+	// retourne l'indice du sommet existant equivalent, INVALID sinon
+	uint32_t Find(const tinyobj::index_t& index, const Vertex& v) const
+	{
+		auto it = indexMap.find({ index.vertex_index, index.normal_index, index.texcoord_index });
+		if (it != indexMap.end())
+			return it->second;
+		if (!useEpsilon)
+			return INVALID;
+
+		uint32_t found = INVALID;
+		const CellKey center = Cell(v.position);
+		for (int64_t dz = -1; dz <= 1; ++dz) {
+			for (int64_t dy = -1; dy <= 1; ++dy) {
+				for (int64_t dx = -1; dx <= 1; ++dx) {
+					auto cell = cellHeads.find({ center.x + dx, center.y + dy, center.z + dz });
+					if (cell == cellHeads.end())
+						continue;
+					for (uint32_t i = cell->second; i != INVALID; i = cellNext[i]) {
+						if (i < found && v.IsSame(vertices[i]))
+							found = i;
+					}
+				}
+			}
+		}
+		return found;
+	}
+
+	// enregistre le triplet d'indices (et le sommet s'il vient d'etre emis)
+	void Insert(const tinyobj::index_t& index, const Vertex& v, uint32_t vertexIndex, bool isNew)
+	{
+		indexMap.insert({ { index.vertex_index, index.normal_index, index.texcoord_index }, vertexIndex });
+		if (!useEpsilon || !isNew)
+			return;
+		auto cell = cellHeads.insert({ Cell(v.position), INVALID }).first;
+		cellNext.push_back(cell->second);
+		cell->second = vertexIndex;
+	}
+};
+
 void Mesh::Destroy()
 {
 	// On n'oublie pas de dtruire les objets OpenGL
@@ -28,10 +121,14 @@ void Mesh::Destroy()
 	delete[] meshes;
 }
 
-bool Mesh::ParseObj(Mesh* obj, const char* filepath)
+bool Mesh::ParseObj(Mesh* obj, const char* filepath, const ParseOptions& options)
 {
 	std::string warning, error;
 
+	auto startTime = std::chrono::high_resolution_clock::now();
+	double parseTime = 0.0;
+	size_t verticesIn = 0, verticesOut = 0;
+
 	memset(obj, 0, sizeof(Mesh));
 
 	std::map<std::string, int> material_map;
@@ -50,6 +147,8 @@ bool Mesh::ParseObj(Mesh* obj, const char* filepath)
 		if (error.length())
 			std::cout << "[error]: " << error << std::endl;
 
+		parseTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
 		obj->materials = new Material[materials.size()];
 		memset(obj->materials, 0, sizeof(Material) * materials.size());
 
@@ -84,11 +183,14 @@ bool Mesh::ParseObj(Mesh* obj, const char* filepath)
 			uint32_t* indices = new uint32_t[shape.mesh.indices.size()];
 			submesh->indicesCount = 0;
 
+			VertexWelder welder(vertices, shape.mesh.indices.size(), options.weldEpsilon);
+
 			int materialId = -1;
 			int faceId = 0;
 			for (tinyobj::index_t& index : shape.mesh.indices)
 			{
 				Vertex v;
+				v.normal = { 0.f, 0.f, 0.f };
 
 				// tinyobj ne stocke pas l'identifiant du materiau globalement dans la shape
 				// mais dans les faces..
@@ -137,27 +239,25 @@ bool Mesh::ParseObj(Mesh* obj, const char* filepath)
 				v.color[2] = uint8_t(attrib.colors[3 * index.vertex_index + 2] * 255.99f);
 				v.color[3] = 255;
 
-				uint32_t vertexIndex = 0;
-				// recherche lineaire (lente) afin de tester si le vertex existe deja
-				for (; vertexIndex < submesh->verticesCount; ++vertexIndex)
-				{
-					const Vertex &vi = vertices[vertexIndex];
-					if (v.IsSame(vi)) {
-						break;
-					}
-				}
-
-				if (vertexIndex == submesh->verticesCount)
+				// recherche par hachage (cf. VertexWelder) afin de tester si le vertex existe deja
+				uint32_t vertexIndex = welder.Find(index, v);
+				const bool isNew = (vertexIndex == VertexWelder::INVALID);
+				if (isNew)
 				{
+					vertexIndex = submesh->verticesCount;
 					vertices[vertexIndex] = v;
 					++submesh->verticesCount;
 				}
+				welder.Insert(index, v, vertexIndex, isNew);
 				indices[submesh->indicesCount] = vertexIndex;
 				++submesh->indicesCount;
 
 				faceId++;
 			}
 
+			verticesIn += submesh->indicesCount;
+			verticesOut += submesh->verticesCount;
+
 			submesh->materialId = materialId;
 
 			// notez que je ne cree pas le VAO ici
@@ -171,5 +271,13 @@ bool Mesh::ParseObj(Mesh* obj, const char* filepath)
 		}
 	}
 
+	if (options.verbose)
+	{
+		double totalTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		std::cout << "[ParseObj] " << filepath << " : " << obj->meshCount << " SubMesh, "
+			<< verticesIn << " sommets en entree -> " << verticesOut << " sommets soudes, "
+			<< "lecture OBJ " << parseTime << " ms, total " << totalTime << " ms" << std::endl;
+	}
+
 	return true;
 }
@@ -22,9 +22,18 @@ struct Mesh
 	Material* materials;
 	uint32_t materialCount;
 
+	// options de chargement, les valeurs par defaut correspondent au comportement d'origine
+	struct ParseOptions
+	{
+		bool weldEpsilon;	// soude aussi les sommets "proches" au sens de Vertex::IsSame (et pas seulement identiques)
+		bool verbose;		// affiche un rapport de chargement (sommets en entree/sortie, temps)
+
+		ParseOptions() : weldEpsilon(true), verbose(true) {}
+	};
+
 	void Destroy();
 
-	static bool ParseObj(Mesh* obj, const char* filepath);
+	static bool ParseObj(Mesh* obj, const char* filepath, const ParseOptions& options = ParseOptions());
 };
 
 
@@ -0,0 +1,106 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile() : data(nullptr), size(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+{
+}
+
+bool MappedFile::Open(const char* filepath)
+{
+	Close();
+
+	fileHandle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+		Close();
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle == nullptr) {
+		Close();
+		return false;
+	}
+
+	data = (const uint8_t*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mappingHandle)
+		CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+	data = nullptr;
+	size = 0;
+	mappingHandle = nullptr;
+	fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : data(nullptr), size(0), fileDescriptor(-1)
+{
+}
+
+bool MappedFile::Open(const char* filepath)
+{
+	Close();
+
+	fileDescriptor = open(filepath, O_RDONLY);
+	if (fileDescriptor < 0)
+		return false;
+
+	struct stat sb;
+	if (fstat(fileDescriptor, &sb) != 0 || sb.st_size == 0) {
+		Close();
+		return false;
+	}
+	size = (size_t)sb.st_size;
+
+	void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (p == MAP_FAILED) {
+		Close();
+		return false;
+	}
+	// lecture sequentielle, on encourage le systeme a precharger les pages
+	madvise(p, size, MADV_SEQUENTIAL);
+	data = (const uint8_t*)p;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		munmap((void*)data, size);
+	if (fileDescriptor >= 0)
+		close(fileDescriptor);
+	data = nullptr;
+	size = 0;
+	fileDescriptor = -1;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Projection d'un fichier en memoire (memory mapping) en lecture seule
+// le systeme charge les pages a la demande, aucune copie n'est faite dans un buffer intermediaire
+// contrairement a la lecture via std::ifstream
+struct MappedFile
+{
+	const uint8_t* data;
+	size_t size;
+#if defined(_WIN32)
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+
+	MappedFile();
+	~MappedFile() { Close(); }
+
+	bool Open(const char* filepath);
+	void Close();
+
+	// on interdit la copie, le destructeur libererait deux fois la projection
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+};
@@ -11,7 +11,25 @@ struct Material
 	uint32_t ambientTexture;	// optionnelle
 	uint32_t diffuseTexture;
 	uint32_t specularTexture;	// optionnelle
+	int32_t diffuseArray;		// indice dans Mesh::textureArrays, -1 : diffuseTexture n'est pas regroupee (cf. Mesh::PackTextures)
+	uint32_t diffuseLayer;		// couche du tableau
 
 	static Material defaultMaterial;
 };
 
+// element du tableau u_Materials des shaders (bloc MaterialData, layout std140)
+// en std140 un vec3 est aligne sur 16 octets, le float ou l'int qui le suit occupe sa 4e composante
+struct MaterialBlock
+{
+	vec3 ambientColor;
+	float shininess;
+	vec3 diffuseColor;
+	float diffuseLayer;
+	vec3 specularColor;
+	int32_t diffuseArray;
+};
+
+// un uniform block est garanti jusqu'a 16 Ko : le bloc des shaders contient 256 materiaux (12 Ko, multiple de
+// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT), les suivants sont atteints en decalant la plage liee (glBindBufferRange)
+static const uint32_t MATERIALS_PER_BLOCK = 256;
+
@@ -1,7 +1,15 @@
 
 #include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
 
 #include "tiny_obj_loader.h"
+#include "ParallelObjLoader.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "NormalGenerator.h"
 
 #include "OpenGLcore.h"
 #include "Material.h"
@@ -9,50 +17,506 @@
 #include "Texture.h"
 
 // materiau par defaut (couleur ambiante, couleur diffuse, couleur speculaire, shininess, tex ambient, tex diffuse, tex specular)
-Material Material::defaultMaterial = { { 0.f, 0.f, 0.f }, { 1.f, 1.f, 1.f }, { 0.f, 0.f, 0.f }, 256.f, 0, 1, 0 };
+Material Material::defaultMaterial = { { 0.f, 0.f, 0.f }, { 1.f, 1.f, 1.f }, { 0.f, 0.f, 0.f }, 256.f, 0, 1, 0, -1, 0 };
 
-void Mesh::Destroy()
+// Soudure (welding) des sommets en temps lineaire (en moyenne) a la place de la recherche lineaire en O(n^2)
+// 1. une table de hachage indexee par le triplet d'indices tinyobj (position, normale, texcoords)
+//    retrouve immediatement les sommets deja rencontres, c'est le cas le plus frequent en OBJ
+// 2. un nouveau triplet peut malgre tout designer un sommet "proche" d'un sommet existant (cf. Vertex::IsSame)
+//    on range alors les sommets dans une grille de cellules de taille EPSILON indexee par la position.
+//    Deux positions a moins de EPSILON l'une de l'autre sont forcement dans des cellules voisines,
+//    il suffit donc de tester les 27 cellules autour du sommet
+// Le resultat est identique a la recherche lineaire : on retient le plus petit indice qui correspond
+struct VertexWelder
 {
-	// On n'oublie pas de dtruire les objets OpenGL
-	for (uint32_t i = 0; i < meshCount; i++)
+	struct IndexKey
+	{
+		int32_t v, n, t;
+		bool operator==(const IndexKey& rhs) const { return v == rhs.v && n == rhs.n && t == rhs.t; }
+	};
+	struct CellKey
+	{
+		int64_t x, y, z;
+		bool operator==(const CellKey& rhs) const { return x == rhs.x && y == rhs.y && z == rhs.z; }
+	};
+	struct KeyHash
+	{
+		// combinaison a la boost::hash_combine
+		static inline size_t Combine(size_t seed, uint64_t value) {
+			return seed ^ (size_t(value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+		}
+		size_t operator()(const IndexKey& k) const { return Combine(Combine(Combine(0, uint32_t(k.v)), uint32_t(k.n)), uint32_t(k.t)); }
+		size_t operator()(const CellKey& k) const { return Combine(Combine(Combine(0, k.x), k.y), k.z); }
+	};
+
+	static constexpr uint32_t INVALID = 0xffffffff;
+
+	const Vertex* vertices;		// sommets deja emis (tableau du SubMesh)
+	bool useEpsilon;
+	std::unordered_map<IndexKey, uint32_t, KeyHash> indexMap;
+	std::unordered_map<CellKey, uint32_t, KeyHash> cellHeads;	// premier sommet de chaque cellule
+	std::vector<uint32_t> cellNext;								// liste chainee des sommets d'une meme cellule
+
+	VertexWelder(const Vertex* emitted, size_t capacity, bool epsilon) : vertices(emitted), useEpsilon(epsilon)
+	{
+		indexMap.reserve(capacity);
+		if (useEpsilon) {
+			cellHeads.reserve(capacity);
+			cellNext.reserve(capacity);
+		}
+	}
+
+	static inline CellKey Cell(const vec3& p)
 	{
-		// Comme les VBO ont ete "detruit" a l'initialisation
-		// seul le VAO contient une reference vers ces VBO/IBO
-		// detruire le VAO entraine donc la veritable destruction/deallocation des VBO/IBO
-		//DeleteBufferObject(meshes[i].VBO);
-		//DeleteBufferObject(meshes[i].IBO);
-		glDeleteVertexArrays(1, &meshes[i].VAO);
-		meshes[i].VAO = 0;
+		return { (int64_t)floor(double(p.x) / Vertex::EPSILON), (int64_t)floor(double(p.y) / Vertex::EPSILON), (int64_t)floor(double(p.z) / Vertex::EPSILON) };
 	}
+
+	// retourne l'indice du sommet existant equivalent, INVALID sinon
+	uint32_t Find(const tinyobj::index_t& index, const Vertex& v) const
+	{
+		auto it = indexMap.find({ index.vertex_index, index.normal_index, index.texcoord_index });
+		if (it != indexMap.end())
+			return it->second;
+		if (!useEpsilon)
+			return INVALID;
+
+		uint32_t found = INVALID;
+		const CellKey center = Cell(v.position);
+		for (int64_t dz = -1; dz <= 1; ++dz) {
+			for (int64_t dy = -1; dy <= 1; ++dy) {
+				for (int64_t dx = -1; dx <= 1; ++dx) {
+					auto cell = cellHeads.find({ center.x + dx, center.y + dy, center.z + dz });
+					if (cell == cellHeads.end())
+						continue;
+					for (uint32_t i = cell->second; i != INVALID; i = cellNext[i]) {
+						if (i < found && v.IsSame(vertices[i]))
+							found = i;
+					}
+				}
+			}
+		}
+		return found;
+	}
+
+	// enregistre le triplet d'indices (et le sommet s'il vient d'etre emis)
+	void Insert(const tinyobj::index_t& index, const Vertex& v, uint32_t vertexIndex, bool isNew)
+	{
+		indexMap.insert({ { index.vertex_index, index.normal_index, index.texcoord_index }, vertexIndex });
+		if (!useEpsilon || !isNew)
+			return;
+		auto cell = cellHeads.insert({ Cell(v.position), INVALID }).first;
+		cellNext.push_back(cell->second);
+		cell->second = vertexIndex;
+	}
+};
+
+void Mesh::Destroy()
+{
+	// On n'oublie pas de dtruire les objets OpenGL
+	// Comme les VBO ont ete "detruit" a l'initialisation
+	// seul le VAO contient une reference vers ces VBO/IBO
+	// detruire le VAO entraine donc la veritable destruction/deallocation des VBO/IBO
+	//DeleteBufferObject(VBO);
+	//DeleteBufferObject(IBO);
+	GLState::DeleteVertexArray(VAO);
+	VAO = 0;
+	GLState::DeleteTextures(textureArrayCount, textureArrays);
+	textureArrayCount = 0;
+	DeleteBufferObject(materialUBO);
 	// on supprime le tableau de SubMesh
 	delete[] meshes;
+	delete[] meshlets;
+	// chaque materiau detient une reference sur sa texture (cf. Texture::Release)
+	for (uint32_t i = 0; i < materialCount; i++)
+		Texture::Release(materials[i].diffuseTexture);
+	delete[] materials;
 }
 
-bool Mesh::ParseObj(Mesh* obj, const char* filepath)
+bool Mesh::PackTextures()
+{
+	std::vector<uint32_t> textures(materialCount);
+	std::vector<TextureLayer> layers(materialCount);
+	for (uint32_t i = 0; i < materialCount; i++)
+		textures[i] = materials[i].diffuseTexture;
+	textureArrayCount = PackTextureArrays(textures.data(), materialCount, textureArrays, MAX_TEXTURE_ARRAYS, layers.data());
+	for (uint32_t i = 0; i < materialCount; i++)
+	{
+		if (layers[i].array < 0)
+			continue;
+		materials[i].diffuseArray = layers[i].array;
+		materials[i].diffuseLayer = layers[i].layer;
+		// le contenu est copie dans le tableau, la memoire video n'est pas occupee deux fois
+		Texture::Release(materials[i].diffuseTexture);
+		materials[i].diffuseTexture = 0;
+	}
+	// les shaders lisent le tableau et la couche dans le bloc des materiaux
+	if (textureArrayCount > 0)
+		UploadMaterials();
+	return textureArrayCount > 0;
+}
+
+void Mesh::UploadMaterials()
+{
+	const uint32_t windowCount = (materialCount + MATERIALS_PER_BLOCK) / MATERIALS_PER_BLOCK;
+	std::vector<MaterialBlock> blocks(windowCount * MATERIALS_PER_BLOCK);
+	for (uint32_t i = 0; i <= materialCount; i++)
+	{
+		const Material& mat = i > 0 ? materials[i - 1] : Material::defaultMaterial;
+		blocks[i] = { mat.ambientColor, mat.shininess, mat.diffuseColor, float(mat.diffuseLayer), mat.specularColor, mat.diffuseArray };
+	}
+	const size_t size = sizeof(MaterialBlock) * blocks.size();
+	if (materialUBO == 0)
+		materialUBO = CreateBufferObject(BufferType::UBO, size, blocks.data());
+	else {
+		glBindBuffer(GL_UNIFORM_BUFFER, materialUBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, size, blocks.data());
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+static_assert(MAX_LOD_COUNT == MeshCache::MAX_LOD_COUNT, "le cache doit pouvoir stocker tous les LOD");
+static_assert(sizeof(SubMeshLod) == sizeof(MeshCache::LodEntry), "SubMeshLod et LodEntry doivent etre identiques");
+
+// options de ParseObj qui modifient les donnees produites, un cache ecrit avec d'autres options est perime
+static uint64_t CacheFlags(const Mesh::ParseOptions& options)
+{
+	uint64_t flags = (options.weldEpsilon ? 1 : 0) | (options.optimizeVertexCache ? 2 : 0);
+	// l'ordre des clusters depend du seuil, on l'inclut dans les flags (au 1/100e)
+	if (options.optimizeVertexCache && options.optimizeOverdraw)
+		flags |= 4 | (uint32_t(options.overdrawThreshold * 100.f + 0.5f) << 8);
+	flags |= (options.shortIndices ? 8 : 0) | (options.shortIndices && options.splitForShortIndices ? 16 : 0);
+	flags |= (options.vertexFormat == VERTEX_PACKED ? 32 : 0);
+	// angle de pli en degres entiers (bits 20 a 27)
+	if (options.generateNormals)
+		flags |= 64 | (uint32_t(std::min(std::max(options.creaseAngle, 0.f), 180.f) + 0.5f) << 20);
+	flags |= (options.buildMeshlets ? 128 : 0);
+	// LOD : nombre (bits 32 a 34), reduction au 1/100e (bits 35 a 41), erreur maximale au 1/1000e (bits 42 a 53)
+	const uint32_t lodCount = std::min(options.lodCount, MAX_LOD_COUNT);
+	if (lodCount > 1) {
+		flags |= uint64_t(lodCount) << 32;
+		flags |= uint64_t(std::min(uint32_t(options.lodReduction * 100.f + 0.5f), 127u)) << 35;
+		flags |= uint64_t(std::min(uint32_t(options.lodMaxError * 1000.f + 0.5f), 4095u)) << 42;
+	}
+	return flags;
+}
+
+static inline uint32_t VertexSize(VertexFormat format)
+{
+	return format == VERTEX_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+static inline uint32_t IndexType(uint32_t indexSize)
+{
+	return indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+// tailles des buffers et erreurs de quantification, pour le rapport de ParseObj
+struct BufferStatistics
+{
+	size_t indexBytes;
+	size_t vertexBytes;
+	size_t vertexCount;
+	QuantizationError quantization;
+	size_t meshletVertices;					// somme des sommets distincts de chaque meshlet
+	size_t lodTriangles[MAX_LOD_COUNT];		// somme sur tous les SubMesh (ceux sans ce LOD comptent leur dernier LOD)
+	float lodError[MAX_LOD_COUNT];			// erreur maximale, en fraction du rayon du SubMesh
+
+	BufferStatistics() : indexBytes(0), vertexBytes(0), vertexCount(0), meshletVertices(0)
+	{
+		for (uint32_t lod = 0; lod < MAX_LOD_COUNT; lod++) {
+			lodTriangles[lod] = 0;
+			lodError[lod] = 0.f;
+		}
+	}
+};
+
+// nombre de sommets distincts references par des indices
+static uint32_t CountUniqueVertices(const uint32_t* indices, uint32_t indicesCount)
+{
+	std::vector<uint32_t> unique(indices, indices + indicesCount);
+	std::sort(unique.begin(), unique.end());
+	return uint32_t(std::unique(unique.begin(), unique.end()) - unique.begin());
+}
+
+// sphere englobante : centre de la boite englobante et distance maximale a ce centre
+static void ComputeBoundingSphere(const Vertex* vertices, uint32_t verticesCount, vec3* center, float* radius)
+{
+	QuantizationBounds bounds = ComputeQuantizationBounds(vertices, verticesCount);
+	*center = { bounds.offset.x + bounds.scale.x * 0.5f, bounds.offset.y + bounds.scale.y * 0.5f, bounds.offset.z + bounds.scale.z * 0.5f };
+	float squaredRadius = 0.f;
+	for (uint32_t i = 0; i < verticesCount; i++) {
+		const vec3& p = vertices[i].position;
+		const vec3 d = { p.x - center->x, p.y - center->y, p.z - center->z };
+		squaredRadius = std::max(squaredRadius, d.x * d.x + d.y * d.y + d.z * d.z);
+	}
+	*radius = sqrtf(squaredRadius);
+}
+
+// ajout des sommets et indices d'un SubMesh a ceux du Mesh (cooked), le VBO et l'IBO communs sont crees a la fin
+// la chaine de LOD est ajoutee a la suite des indices du LOD 0 (cf. SimplifyMesh),
+// les indices sont convertis en 16 bits lorsque tous les sommets sont adressables
+// et les sommets sont quantifies si le format VERTEX_PACKED est demande
+// les meshlets du LOD 0 sont ajoutes a meshlets (si ParseOptions::buildMeshlets), l'ordre des triangles
+// du LOD 0 est alors celui des meshlets
+static void CreateSubMesh(SubMesh* submesh, const Vertex* vertices, uint32_t verticesCount, const uint32_t* indices, uint32_t indicesCount,
+	int32_t materialId, const Mesh::ParseOptions& options, MeshCache::Builder* cooked, std::vector<Meshlet>* meshlets, BufferStatistics* stats)
+{
+	submesh->verticesCount = verticesCount;
+	submesh->indicesCount = indicesCount;
+	submesh->materialId = materialId;
+
+	const uint32_t indexSize = (options.shortIndices && verticesCount < 65536) ? sizeof(uint16_t) : sizeof(uint32_t);
+	submesh->indexType = IndexType(indexSize);
+
+	ComputeBoundingSphere(vertices, verticesCount, &submesh->center, &submesh->radius);
+	submesh->lodCount = 1;
+	submesh->lods[0] = { 0, indicesCount, 0.f };
+
+	// les meshlets ne decrivent que le LOD 0 (un LOD simplifie est deja peu couteux)
+	// BuildMeshlets reordonne les triangles, on travaille sur une copie des indices
+	submesh->firstMeshlet = uint32_t(meshlets->size());
+	submesh->meshletCount = 0;
+	std::vector<uint32_t> meshletIndices;
+	if (options.buildMeshlets)
+	{
+		meshletIndices.assign(indices, indices + indicesCount);
+		indices = meshletIndices.data();
+		std::vector<Meshlet> subMeshlets;
+		BuildMeshlets(subMeshlets, meshletIndices.data(), indicesCount, vertices, verticesCount);
+		for (const Meshlet& meshlet : subMeshlets)
+			stats->meshletVertices += CountUniqueVertices(indices + meshlet.firstIndex, meshlet.indicesCount);
+		meshlets->insert(meshlets->end(), subMeshlets.begin(), subMeshlets.end());
+		submesh->meshletCount = uint32_t(subMeshlets.size());
+	}
+
+	std::vector<uint32_t> lodBuffer;
+	const uint32_t lodCount = std::min(options.lodCount, MAX_LOD_COUNT);
+	if (lodCount > 1)
+	{
+		lodBuffer.assign(indices, indices + indicesCount);
+		std::vector<uint32_t> simplified(indicesCount);
+		size_t target = indicesCount;
+		for (uint32_t lod = 1; lod < lodCount; lod++)
+		{
+			// chaque LOD est simplifie depuis le LOD 0, l'erreur ne se cumule pas d'un niveau a l'autre
+			target = size_t(target * options.lodReduction) / 3 * 3;
+			float error = 0.f;
+			const size_t count = SimplifyMesh(simplified.data(), indices, indicesCount, vertices, verticesCount,
+				target, options.lodMaxError * submesh->radius, &error);
+			// simplification bloquee (bords, erreur maximale) : un LOD presque identique au precedent est inutile
+			if (count == 0 || count > submesh->lods[lod - 1].indicesCount * 9 / 10)
+				break;
+			if (options.optimizeVertexCache)
+				OptimizeVertexCache(simplified.data(), simplified.data(), count, verticesCount);
+			submesh->lods[lod] = { uint32_t(lodBuffer.size()) * indexSize, uint32_t(count), error };
+			lodBuffer.insert(lodBuffer.end(), simplified.begin(), simplified.begin() + count);
+			submesh->lodCount = lod + 1;
+		}
+		indices = lodBuffer.data();
+		indicesCount = uint32_t(lodBuffer.size());
+	}
+	for (uint32_t lod = 0; lod < MAX_LOD_COUNT; lod++) {
+		const SubMeshLod& range = submesh->lods[std::min(lod, submesh->lodCount - 1)];
+		stats->lodTriangles[lod] += range.indicesCount / 3;
+		if (submesh->radius > 0.f)
+			stats->lodError[lod] = std::max(stats->lodError[lod], range.error / submesh->radius);
+	}
+
+	std::vector<uint16_t> shortBuffer;
+	const void* indexData = indices;
+	if (indexSize == sizeof(uint16_t)) {
+		shortBuffer.assign(indices, indices + indicesCount);
+		indexData = shortBuffer.data();
+	}
+
+	std::vector<PackedVertex> packedBuffer;
+	const void* vertexData = vertices;
+	submesh->positionOffset = { 0.f, 0.f, 0.f };
+	submesh->positionScale = { 1.f, 1.f, 1.f };
+	if (options.vertexFormat == VERTEX_PACKED) {
+		QuantizationBounds bounds = ComputeQuantizationBounds(vertices, verticesCount);
+		packedBuffer.resize(verticesCount);
+		PackVertices(packedBuffer.data(), vertices, verticesCount, bounds, &stats->quantization);
+		vertexData = packedBuffer.data();
+		submesh->positionOffset = bounds.offset;
+		submesh->positionScale = bounds.scale;
+	}
+	const uint32_t vertexSize = VertexSize(options.vertexFormat);
+
+	stats->indexBytes += size_t(indexSize) * indicesCount;
+	stats->vertexBytes += size_t(vertexSize) * verticesCount;
+	stats->vertexCount += verticesCount;
+
+	MeshCache::SubMeshEntry entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.verticesCount = verticesCount;
+	entry.indicesCount = indicesCount;
+	entry.materialId = materialId;
+	entry.indexSize = indexSize;
+	entry.positionOffset = submesh->positionOffset;
+	entry.positionScale = submesh->positionScale;
+	entry.center = submesh->center;
+	entry.radius = submesh->radius;
+	entry.lodCount = submesh->lodCount;
+	memcpy(entry.lods, submesh->lods, sizeof(SubMeshLod) * submesh->lodCount);
+	entry.meshletCount = submesh->meshletCount;
+	cooked->AddSubMesh(entry, vertexData, indexData, meshlets->data() + submesh->firstMeshlet);
+	submesh->baseVertex = cooked->subMeshes.back().firstVertex;
+	submesh->indexOffset = cooked->subMeshes.back().indexOffset;
+}
+
+// decodage en parallele des textures des materiaux (cf. Texture::LoadTextures), paths[i] : texture du materiau i
+static void LoadMaterialTextures(Mesh* obj, const std::vector<std::string>& paths, const Mesh::ParseOptions& options)
+{
+	std::vector<const char*> names(paths.size());
+	std::vector<uint32_t> ids(paths.size());
+	for (size_t i = 0; i < paths.size(); i++)
+		names[i] = paths[i].c_str();
+	Texture::LoadOptions textureOptions;
+	textureOptions.threadCount = options.threadCount;
+	textureOptions.verbose = options.verbose;
+	textureOptions.useCache = options.useCache;
+	textureOptions.compress = options.compressTextures;
+	textureOptions.stream = options.streamTextures;
+	textureOptions.cacheDirectory = options.cacheDirectory;
+	Texture::LoadTextures(names.data(), ids.data(), names.size(), textureOptions);
+	for (size_t i = 0; i < paths.size(); i++) {
+		obj->materials[i].diffuseTexture = ids[i];
+		obj->materials[i].diffuseArray = -1;
+	}
+}
+
+// creation des SubMesh et materiaux directement depuis la projection memoire du cache
+// les sections des sommets et des indices sont transmises telles quelles a glBufferData (un seul VBO et IBO)
+static void LoadCookedMesh(Mesh* obj, const MeshCache::Reader& cache, const std::string& mtlPath, const Mesh::ParseOptions& options)
+{
+	const MeshCache::Header* header = cache.header;
+	obj->vertexFormat = options.vertexFormat;
+
+	obj->materials = new Material[header->materialCount];
+	memset(obj->materials, 0, sizeof(Material) * header->materialCount);
+	std::vector<std::string> texturePaths(header->materialCount);
+	for (uint32_t i = 0; i < header->materialCount; i++)
+	{
+		const MeshCache::MaterialEntry& entry = cache.materials[i];
+		Material& mat = obj->materials[i];
+		mat.ambientColor = entry.ambientColor;
+		mat.diffuseColor = entry.diffuseColor;
+		mat.specularColor = entry.specularColor;
+		mat.shininess = entry.shininess;
+		texturePaths[i] = mtlPath + "/" + cache.String(entry.diffuseTextureName);
+	}
+	obj->materialCount = header->materialCount;
+	LoadMaterialTextures(obj, texturePaths, options);
+
+	obj->meshlets = new Meshlet[header->meshletCount];
+	memcpy(obj->meshlets, cache.meshlets, sizeof(Meshlet) * header->meshletCount);
+	obj->meshletCount = header->meshletCount;
+
+	obj->meshes = new SubMesh[header->subMeshCount];
+	memset(obj->meshes, 0, sizeof(SubMesh) * header->subMeshCount);
+	for (uint32_t i = 0; i < header->subMeshCount; i++)
+	{
+		const MeshCache::SubMeshEntry& entry = cache.subMeshes[i];
+		SubMesh* submesh = &obj->meshes[i];
+		submesh->verticesCount = entry.verticesCount;
+		submesh->indicesCount = entry.lods[0].indicesCount;
+		submesh->materialId = entry.materialId;
+		submesh->indexType = IndexType(entry.indexSize);
+		submesh->positionOffset = entry.positionOffset;
+		submesh->positionScale = entry.positionScale;
+		submesh->center = entry.center;
+		submesh->radius = entry.radius;
+		submesh->lodCount = entry.lodCount;
+		memcpy(submesh->lods, entry.lods, sizeof(SubMeshLod) * entry.lodCount);
+		submesh->firstMeshlet = entry.firstMeshlet;
+		submesh->meshletCount = entry.meshletCount;
+		submesh->baseVertex = entry.firstVertex;
+		submesh->indexOffset = entry.indexOffset;
+	}
+	obj->meshCount = header->subMeshCount;
+
+	// notez que je ne cree pas le VAO ici
+	// Un VAO fait le lien entre le VBO (+ EBO/IBO) et les attributs d'un vertex shader
+	obj->VBO = CreateBufferObject(BufferType::VBO, size_t(header->vertexSize) * header->vertexCount, cache.vertexData);
+	obj->IBO = CreateBufferObject(BufferType::IBO, size_t(header->indexBytes), cache.indexData);
+}
+
+bool Mesh::ParseObj(Mesh* obj, const char* filepath, const ParseOptions& options)
 {
 	std::string warning, error;
 
+	auto startTime = std::chrono::high_resolution_clock::now();
+	double parseTime = 0.0;
+	size_t verticesIn = 0, verticesOut = 0;
+	size_t normalsGenerated = 0;
+	double normalTime = 0.0;
+	size_t transformedBefore = 0, transformedAfter = 0;		// cf. AnalyzeVertexCache
+	uint64_t shadedBefore = 0, shadedAfter = 0, covered = 0;	// cf. AnalyzeOverdraw
+	BufferStatistics bufferStats;
+
 	memset(obj, 0, sizeof(Mesh));
 
 	std::map<std::string, int> material_map;
 	std::vector<tinyobj::material_t> materials;
+	// repertoire du fichier OBJ (separateurs '/' ou '\'), repertoire courant pour un simple nom de fichier
 	std::string mtlPath = filepath;
+	const size_t separator = mtlPath.find_last_of("/\\");
+	if (separator != std::string::npos)
+		mtlPath.resize(separator);
+	else
+		mtlPath = ".";
+
+	// si le cache est a jour on ne lit pas du tout le fichier OBJ
+	FileStamp sourceStamp;
+	const bool hasStamp = options.useCache && FileStamp::Get(filepath, &sourceStamp);
+	std::string cachePath;
+	if (hasStamp)
+	{
+		cachePath = MeshCache::PathFor(filepath, options.cacheDirectory);
+		MeshCache::Reader cache;
+		if (cache.Open(cachePath.c_str(), sourceStamp, CacheFlags(options), VertexSize(options.vertexFormat)))
+		{
+			LoadCookedMesh(obj, cache, mtlPath, options);
+			if (options.verbose)
+			{
+				double totalTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+				std::cout << "[ParseObj] " << filepath << " : " << obj->meshCount << " SubMesh, "
+					<< cache.header->vertexCount << " sommets lus depuis le cache " << cachePath
+					<< ", total " << totalTime << " ms" << std::endl;
+			}
+			return true;
+		}
+	}
+	MeshCache::Builder cooked;
+	cooked.vertexSize = VertexSize(options.vertexFormat);
+	obj->vertexFormat = options.vertexFormat;
 
 	{
-		size_t off = mtlPath.rfind("/");
-		mtlPath.resize(off);
 		std::vector<tinyobj::shape_t> shapes;
 		tinyobj::attrib_t attrib;
 
-		bool ok = tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, filepath, mtlPath.c_str());
+		// les deux chargeurs produisent exactement les memes donnees
+		bool ok = options.parallelLoad
+			? LoadObjParallel(&attrib, &shapes, &materials, &warning, &error, filepath, mtlPath.c_str(), options.threadCount)
+			: tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, filepath, mtlPath.c_str());
 		if (warning.length())
 			std::cout << "[warning]: " << warning << std::endl;
 		if (error.length())
 			std::cout << "[error]: " << error << std::endl;
+		// fichier illisible ou ligne de face invalide : shapes et materials sont vides, rien n'est mis en cache
+		// obj n'a encore rien alloue (cf. memset plus haut), il reste un Mesh vide
+		if (!ok)
+			return false;
+
+		parseTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
 
 		obj->materials = new Material[materials.size()];
 		memset(obj->materials, 0, sizeof(Material) * materials.size());
 
+		// les textures sont chargees ensemble a la fin de la boucle (decodage multi-thread)
+		std::vector<std::string> texturePaths;
+		texturePaths.reserve(materials.size());
 		for (tinyobj::material_t& material : materials)
 		{
 			Material& mat = obj->materials[obj->materialCount];
@@ -60,115 +524,243 @@ bool Mesh::ParseObj(Mesh* obj, const char* filepath)
 			memcpy(&mat.diffuseColor, material.diffuse, sizeof(vec3));
 			memcpy(&mat.specularColor, material.specular, sizeof(vec3));
 			mat.shininess = material.shininess;
-			mat.diffuseTexture = Texture::LoadTexture((mtlPath + "/" + material.diffuse_texname).c_str());
+			texturePaths.push_back(mtlPath + "/" + material.diffuse_texname);
 			++obj->materialCount;
+
+			if (hasStamp) {
+				MeshCache::MaterialEntry entry;
+				entry.ambientColor = mat.ambientColor;
+				entry.diffuseColor = mat.diffuseColor;
+				entry.specularColor = mat.specularColor;
+				entry.shininess = mat.shininess;
+				entry.diffuseTextureName = cooked.AddString(material.diffuse_texname);
+				cooked.materials.push_back(entry);
+			}
 		}
+		LoadMaterialTextures(obj, texturePaths, options);
 
 		// On va grer plusieurs objets / groupes OBJ - ce que tinyobj appelle des shapes
-		// chaque shape est un mesh, plus precisement ici un submesh
+		// chaque shape est un mesh, plus precisement ici un ou plusieurs submesh
 		// le format OBJ ne dfini pas de hierarchie claire, il n'est pas toujours evident de savoir
 		// si une "shape" est un objet  part ou une sous partie d'un autre...j'ai fait le choix de la sous partie
-		obj->meshes = new SubMesh[shapes.size()];
-		// note: attention  ne pas utiliser memset avec des classes polymorphiques (virtual) 
-		// vous risquez d'craser les pointeurs vers la table virtuelle (vtable)
-		memset(obj->meshes, 0, sizeof(SubMesh) * shapes.size());
+		// tinyobj ne stocke pas l'identifiant du materiau globalement dans la shape mais dans les faces,
+		// une shape dont les faces utilisent plusieurs materiaux est donc decoupee en un SubMesh par materiau
+		// (dans l'ordre de premiere apparition, l'ordre des faces est conserve a l'interieur d'un SubMesh)
+		std::vector<std::vector<int>> shapeMaterials(shapes.size());
+		size_t subMeshTotal = 0;
+		for (size_t s = 0; s < shapes.size(); s++)
+		{
+			for (int materialId : shapes[s].mesh.material_ids) {
+				if (std::find(shapeMaterials[s].begin(), shapeMaterials[s].end(), materialId) == shapeMaterials[s].end())
+					shapeMaterials[s].push_back(materialId);
+			}
+			subMeshTotal += shapeMaterials[s].size();
+		}
 
-		for (tinyobj::shape_t& shape : shapes)
+		// le nombre final de SubMesh n'est connu qu'a la fin (cf. splitForShortIndices)
+		std::vector<SubMesh> submeshes;
+		submeshes.reserve(subMeshTotal);
+		std::vector<Meshlet> meshlets;
+		// les sommets et indices sont accumules dans cooked meme sans cache (VBO/IBO communs)
+		MeshCache::Builder* cookedBuilder = &cooked;
+
+		for (size_t s = 0; s < shapes.size(); s++)
 		{
-			SubMesh* submesh = &obj->meshes[obj->meshCount];
-			++obj->meshCount;
+			tinyobj::shape_t& shape = shapes[s];
+			const size_t faceCount = shape.mesh.material_ids.size();
+
+			// les coins sans 'vn' recoivent une normale generee (et un normal_index), cf. NormalGenerator.h
+			if (options.generateNormals)
+			{
+				auto normalStart = std::chrono::high_resolution_clock::now();
+				normalsGenerated += GenerateNormals(attrib, shape, options.creaseAngle, options.threadCount);
+				normalTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - normalStart).count();
+			}
 
-			// buffer temporaire, on va tout stocker ct GPU
+			// buffers temporaires (reutilises pour chaque materiau de la shape), on va tout stocker ct GPU
 			Vertex* vertices = new Vertex[shape.mesh.indices.size()];
-			submesh->verticesCount = 0;
 			uint32_t* indices = new uint32_t[shape.mesh.indices.size()];
-			submesh->indicesCount = 0;
 
-			int materialId = -1;
-			int faceId = 0;
-			for (tinyobj::index_t& index : shape.mesh.indices)
+			for (int materialId : shapeMaterials[s])
 			{
-				Vertex v;
-
-				// tinyobj ne stocke pas l'identifiant du materiau globalement dans la shape
-				// mais dans les faces..
-				int currentMaterialId = shape.mesh.material_ids[faceId / 3];
-				// techniquement si des faces d'une mme shape ont des
-				// materiaux differents il faudrait crer un SubMesh  chaque matriaux dans une shape.
-				// ici, je me contente de selectionner le dernier material_id pour le SubMesh actuel
-				if (currentMaterialId != materialId)
-					materialId = currentMaterialId;
-
-				v.position.x = attrib.vertices[3 * index.vertex_index + 0];
-				v.position.y = attrib.vertices[3 * index.vertex_index + 1];
-				v.position.z = attrib.vertices[3 * index.vertex_index + 2];
-				
-				if (index.normal_index > -1) {
-					v.normal.x = attrib.normals[3 * index.normal_index + 0];
-					v.normal.y = attrib.normals[3 * index.normal_index + 1];
-					v.normal.z = attrib.normals[3 * index.normal_index + 2];
-				}
-				else
+				SubMesh current;
+				memset(&current, 0, sizeof(SubMesh));
+				SubMesh* submesh = &current;
+
+				VertexWelder welder(vertices, shape.mesh.indices.size(), options.weldEpsilon);
+
+				for (size_t faceId = 0; faceId < faceCount; faceId++)
 				{
-					// todo : gnrer des normales
-					bool useSmoothingGroup = false;
-					if (shape.mesh.smoothing_group_ids.size() != 0)
-						useSmoothingGroup = true;
-				}
+					if (shape.mesh.material_ids[faceId] != materialId)
+						continue;
+
+					for (size_t corner = 0; corner < 3; corner++)
+					{
+						const tinyobj::index_t& index = shape.mesh.indices[3 * faceId + corner];
+
+						Vertex v;
+						v.normal = { 0.f, 0.f, 0.f };
+
+						v.position.x = attrib.vertices[3 * index.vertex_index + 0];
+						v.position.y = attrib.vertices[3 * index.vertex_index + 1];
+						v.position.z = attrib.vertices[3 * index.vertex_index + 2];
+						
+						if (index.normal_index > -1) {
+							v.normal.x = attrib.normals[3 * index.normal_index + 0];
+							v.normal.y = attrib.normals[3 * index.normal_index + 1];
+							v.normal.z = attrib.normals[3 * index.normal_index + 2];
+						}
+						// sinon la normale reste nulle (generateNormals desactive)
 
-				v.texcoords = { 0.f, 0.f };
-				if (index.texcoord_index > -1) {
-					v.texcoords.x = attrib.texcoords[2 * index.texcoord_index + 0];
-					v.texcoords.y = attrib.texcoords[2 * index.texcoord_index + 1];
-					// Important  savoir
-					// contrairement  OpenGL, les textures dans les logiciels 2D et 3D
-					// ont pour origine le coin haut-gauche de l'cran
-					// Il est donc souvent ncessaire de convertir la cordonnes v (y)
-					// en C++ ou dans le shader, par exemple ici 
-					v.texcoords.y = 1.f - v.texcoords.y;
+						v.texcoords = { 0.f, 0.f };
+						if (index.texcoord_index > -1) {
+							v.texcoords.x = attrib.texcoords[2 * index.texcoord_index + 0];
+							v.texcoords.y = attrib.texcoords[2 * index.texcoord_index + 1];
+							// Important  savoir
+							// contrairement  OpenGL, les textures dans les logiciels 2D et 3D
+							// ont pour origine le coin haut-gauche de l'cran
+							// Il est donc souvent ncessaire de convertir la cordonnes v (y)
+							// en C++ ou dans le shader, par exemple ici 
+							v.texcoords.y = 1.f - v.texcoords.y;
+						}
+
+						// tinyobj loader affecte du blanc par defaut lorsqu'il ne trouve pas de couleur
+						// c'est gnralement le cas car les couleurs sont une extension non standard du format OBJ
+						// ce qui rend cet attribut purement optionnel
+						// notez que les couleurs sont volontairement converties en RGBA8 pour gagner de la place en memoire
+						// les couleurs restent en sRGB : sur 8 bits la precision est repartie selon la perception,
+						// une valeur lineaire perdrait les teintes sombres (decompression gamma par le vertex shader)
+						v.color[0] = uint8_t(attrib.colors[3 * index.vertex_index + 0] * 255.99f);
+						v.color[1] = uint8_t(attrib.colors[3 * index.vertex_index + 1] * 255.99f);
+						v.color[2] = uint8_t(attrib.colors[3 * index.vertex_index + 2] * 255.99f);
+						v.color[3] = 255;
+
+						// recherche par hachage (cf. VertexWelder) afin de tester si le vertex existe deja
+						uint32_t vertexIndex = welder.Find(index, v);
+						const bool isNew = (vertexIndex == VertexWelder::INVALID);
+						if (isNew)
+						{
+							vertexIndex = submesh->verticesCount;
+							vertices[vertexIndex] = v;
+							++submesh->verticesCount;
+						}
+						welder.Insert(index, v, vertexIndex, isNew);
+						indices[submesh->indicesCount] = vertexIndex;
+						++submesh->indicesCount;
+					}
 				}
 
-				// tinyobj loader affecte du blanc par defaut lorsqu'il ne trouve pas de couleur
-				// c'est gnralement le cas car les couleurs sont une extension non standard du format OBJ
-				// ce qui rend cet attribut purement optionnel
-				// notez que les couleurs sont volontairement converties en RGBA8 pour gagner de la place en memoire
-				v.color[0] = uint8_t(attrib.colors[3 * index.vertex_index + 0] * 255.99f);
-				v.color[1] = uint8_t(attrib.colors[3 * index.vertex_index + 1] * 255.99f);
-				v.color[2] = uint8_t(attrib.colors[3 * index.vertex_index + 2] * 255.99f);
-				v.color[3] = 255;
-
-				uint32_t vertexIndex = 0;
-				// recherche lineaire (lente) afin de tester si le vertex existe deja
-				for (; vertexIndex < submesh->verticesCount; ++vertexIndex)
+				// reordonne les triangles puis les sommets pour le cache post-transformation du GPU
+				if (options.optimizeVertexCache)
 				{
-					const Vertex &vi = vertices[vertexIndex];
-					if (v.IsSame(vi)) {
-						break;
+					transformedBefore += AnalyzeVertexCache(indices, submesh->indicesCount, submesh->verticesCount).transformedVertices;
+					// l'estimation de l'overdraw (rasterisation logicielle) est couteuse, elle n'est faite qu'a la demande
+					const bool measureOverdraw = options.optimizeOverdraw && options.analyzeOverdraw && options.verbose;
+					if (measureOverdraw)
+						shadedBefore += AnalyzeOverdraw(indices, submesh->indicesCount, vertices, submesh->verticesCount).pixelsShaded;
+
+					OptimizeVertexCache(indices, indices, submesh->indicesCount, submesh->verticesCount);
+					if (options.optimizeOverdraw)
+						OptimizeOverdraw(indices, indices, submesh->indicesCount, vertices, submesh->verticesCount, options.overdrawThreshold);
+
+					if (measureOverdraw) {
+						OverdrawStatistics overdraw = AnalyzeOverdraw(indices, submesh->indicesCount, vertices, submesh->verticesCount);
+						shadedAfter += overdraw.pixelsShaded;
+						covered += overdraw.pixelsCovered;
 					}
+					submesh->verticesCount = OptimizeVertexFetch(vertices, indices, submesh->indicesCount, submesh->verticesCount);
+					transformedAfter += AnalyzeVertexCache(indices, submesh->indicesCount, submesh->verticesCount).transformedVertices;
 				}
 
-				if (vertexIndex == submesh->verticesCount)
+				verticesIn += submesh->indicesCount;
+				verticesOut += submesh->verticesCount;
+
+				if (options.shortIndices && options.splitForShortIndices && submesh->verticesCount >= 65536)
 				{
-					vertices[vertexIndex] = v;
-					++submesh->verticesCount;
+					// chaque partie devient un SubMesh (de meme materiau) adressable en 16 bits
+					std::vector<MeshPart> parts;
+					SplitMesh(parts, vertices, submesh->verticesCount, indices, submesh->indicesCount);
+					for (MeshPart& part : parts)
+					{
+						CreateSubMesh(submesh, part.vertices.data(), uint32_t(part.vertices.size()), part.indices.data(), uint32_t(part.indices.size()),
+							materialId, options, cookedBuilder, &meshlets, &bufferStats);
+						submeshes.push_back(*submesh);
+					}
+				}
+				else
+				{
+					CreateSubMesh(submesh, vertices, submesh->verticesCount, indices, submesh->indicesCount, materialId, options, cookedBuilder,
+						&meshlets, &bufferStats);
+					submeshes.push_back(*submesh);
 				}
-				indices[submesh->indicesCount] = vertexIndex;
-				++submesh->indicesCount;
-
-				faceId++;
 			}
 
-			submesh->materialId = materialId;
-
-			// notez que je ne cree pas le VAO ici
-			// Un VAO fait le lien entre le VBO (+ EBO/IBO) et les attributs d'un vertex shader
-			submesh->VBO = CreateBufferObject(BufferType::VBO, sizeof(Vertex) * submesh->verticesCount, vertices);
-			submesh->IBO = CreateBufferObject(BufferType::IBO, sizeof(uint32_t) * submesh->indicesCount, indices);
-
 			// important, bien librer la mmoire des buffers temporaires
 			delete[] indices;
 			delete[] vertices;
 		}
+
+		obj->meshes = new SubMesh[submeshes.size()];
+		// note: attention  ne pas utiliser memset/memcpy avec des classes polymorphiques (virtual) 
+		// vous risquez d'craser les pointeurs vers la table virtuelle (vtable)
+		memcpy(obj->meshes, submeshes.data(), sizeof(SubMesh) * submeshes.size());
+		obj->meshCount = uint32_t(submeshes.size());
+
+		obj->meshlets = new Meshlet[meshlets.size()];
+		memcpy(obj->meshlets, meshlets.data(), sizeof(Meshlet) * meshlets.size());
+		obj->meshletCount = uint32_t(meshlets.size());
+
+		// notez que je ne cree pas le VAO ici
+		// Un VAO fait le lien entre le VBO (+ EBO/IBO) et les attributs d'un vertex shader
+		obj->VBO = CreateBufferObject(BufferType::VBO, cooked.vertexData.size(), cooked.vertexData.data());
+		obj->IBO = CreateBufferObject(BufferType::IBO, cooked.indexData.size(), cooked.indexData.data());
+	}
+
+	// ecriture du cache pour les prochains lancements
+	if (hasStamp && !cooked.Save(cachePath.c_str(), sourceStamp, CacheFlags(options)))
+		std::cout << "[warning]: impossible d'ecrire le cache " << cachePath << std::endl;
+
+	obj->UploadMaterials();
+
+	if (options.verbose)
+	{
+		double totalTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		std::cout << "[ParseObj] " << filepath << " : " << obj->meshCount << " SubMesh, "
+			<< verticesIn << " sommets en entree -> " << verticesOut << " sommets soudes, "
+			<< "lecture OBJ " << parseTime << " ms, total " << totalTime << " ms" << std::endl;
+		if (normalsGenerated > 0)
+			std::cout << "[ParseObj] " << normalsGenerated << " normales generees en " << normalTime << " ms" << std::endl;
+		if (options.shortIndices)
+			std::cout << "[ParseObj] index buffers : " << verticesIn * sizeof(uint32_t) << " octets en 32 bits -> "
+				<< bufferStats.indexBytes << " octets" << std::endl;
+		if (options.vertexFormat == VERTEX_PACKED)
+		{
+			const size_t floatBytes = bufferStats.vertexCount * sizeof(Vertex);
+			std::cout << "[ParseObj] sommets compacts : " << floatBytes << " octets -> " << bufferStats.vertexBytes << " octets (-"
+				<< (floatBytes ? 100 * (floatBytes - bufferStats.vertexBytes) / floatBytes : 0) << "%), erreur max : position "
+				<< bufferStats.quantization.position << ", normale " << bufferStats.quantization.normalDegrees << " deg, uv "
+				<< bufferStats.quantization.texcoords << std::endl;
+		}
+		if (obj->meshletCount > 0)
+			std::cout << "[ParseObj] " << obj->meshletCount << " meshlets, en moyenne " << double(bufferStats.meshletVertices) / obj->meshletCount
+				<< " sommets et " << double(verticesIn / 3) / obj->meshletCount << " triangles" << std::endl;
+		if (std::min(options.lodCount, MAX_LOD_COUNT) > 1)
+		{
+			std::cout << "[ParseObj] LOD (triangles, erreur max en % du rayon) :";
+			for (uint32_t lod = 0; lod < std::min(options.lodCount, MAX_LOD_COUNT); lod++)
+				std::cout << " " << lod << " : " << bufferStats.lodTriangles[lod] << " (" << 100.f * bufferStats.lodError[lod] << "%)";
+			std::cout << std::endl;
+		}
+		if (options.optimizeVertexCache && verticesOut > 0)
+		{
+			const double triangles = double(verticesIn / 3);
+			std::cout << "[ParseObj] cache de sommets (FIFO " << VERTEX_CACHE_SIZE << ") : ACMR "
+				<< transformedBefore / triangles << " -> " << transformedAfter / triangles << ", ATVR "
+				<< double(transformedBefore) / verticesOut << " -> " << double(transformedAfter) / verticesOut << std::endl;
+			if (options.optimizeOverdraw && covered > 0)
+				std::cout << "[ParseObj] overdraw estime (rasterisation logicielle) : "
+					<< double(shadedBefore) / covered << " -> " << double(shadedAfter) / covered << std::endl;
+		}
 	}
 
 	return true;
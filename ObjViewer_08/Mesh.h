@@ -2,29 +2,99 @@
 
 #include "Vertex.h"
 #include "Material.h"
+#include "MeshOptimizer.h"
+#include "TextureArray.h"
 
+// nombre maximum de niveaux de detail d'un SubMesh (LOD 0 compris)
+static const uint32_t MAX_LOD_COUNT = 4;
+
+// niveau de detail : intervalle de l'index buffer du SubMesh, tous les LOD partagent les memes sommets
+struct SubMeshLod
+{
+	uint32_t indexOffset;	// en octets depuis SubMesh::indexOffset
+	uint32_t indicesCount;
+	float error;			// erreur geometrique par rapport au LOD 0 (distance, en unites du modele)
+};
+
+// les sommets et indices de tous les SubMesh sont a la suite dans le VBO et l'IBO du Mesh
+// les indices d'un SubMesh sont locaux, ils sont decales de baseVertex par glDrawElementsBaseVertex
 struct SubMesh
 {
-	uint32_t VAO;	// notez qu'il faut crer un VAO par SubMesh (VBO) quand bien meme on utilise le meme shader
-	uint32_t VBO;	// ceci parceque l'identifiant du VBO est logiquement different a chaque fois
-	uint32_t IBO;
+	uint32_t baseVertex;	// premier sommet du SubMesh dans le VBO du Mesh
+	uint32_t indexOffset;	// en octets dans l'IBO du Mesh, debut du LOD 0 (multiple de 4)
 	uint32_t verticesCount;
-	uint32_t indicesCount;
+	uint32_t indicesCount;	// du LOD 0
+	uint32_t indexType;		// GL_UNSIGNED_SHORT ou GL_UNSIGNED_INT, a passer a glDrawElements
 	int32_t materialId;
+	vec3 positionOffset;	// dequantification des positions (u_PositionOffset, u_PositionScale)
+	vec3 positionScale;		// offset = 0 et scale = 1 pour le format VERTEX_FLOAT
+	vec3 center;			// sphere englobante, en unites du modele (selection du LOD)
+	float radius;
+	uint32_t lodCount;		// 1 lorsque ParseOptions::lodCount <= 1
+	SubMeshLod lods[MAX_LOD_COUNT];	// lods[0] : index buffer complet
+	uint32_t firstMeshlet;	// meshlets du LOD 0 dans Mesh::meshlets (meshletCount = 0 sans ParseOptions::buildMeshlets)
+	uint32_t meshletCount;
 };
 
 // J'utilise volontairement des pointeurs plutt que des std::vector afin d'insister 
 // sur les problmatiques d'allocation et surtout dallocation mmoire (cf. Destroy)
 struct Mesh
 {
+	uint32_t VAO;	// un seul VAO pour tous les SubMesh puisqu'ils partagent le meme VBO/IBO et le meme format de sommet
+	uint32_t VBO;	// (cree par l'application, cf. configuration des attributs du shader)
+	uint32_t IBO;
 	SubMesh* meshes;
 	uint32_t meshCount;
 	Material* materials;
 	uint32_t materialCount;
+	Meshlet* meshlets;			// meshlets de tous les SubMesh (cf. SubMesh::firstMeshlet)
+	uint32_t meshletCount;
+	VertexFormat vertexFormat;	// commun a tous les SubMesh, determine la configuration du VAO
+	uint32_t textureArrays[MAX_TEXTURE_ARRAYS];	// textures des materiaux regroupees (cf. PackTextures)
+	uint32_t textureArrayCount;
+	// materiaux au format MaterialBlock, le materiau par defaut en premier puis materials[i] en i + 1 (cf. UploadMaterials)
+	uint32_t materialUBO;
+
+	// options de chargement, les valeurs par defaut correspondent au comportement d'origine
+	struct ParseOptions
+	{
+		bool weldEpsilon;		// soude aussi les sommets "proches" au sens de Vertex::IsSame (et pas seulement identiques)
+		bool verbose;			// affiche un rapport de chargement (sommets en entree/sortie, temps)
+		bool parallelLoad;		// lecture du fichier OBJ multi-thread via LoadObjParallel (cf. ParallelObjLoader.h)
+		uint32_t threadCount;	// nombre de threads de lecture, 0 = nombre de coeurs
+		bool useCache;			// lit/ecrit un cache binaire .mesh (cf. MeshCache.h), l'OBJ n'est relu que s'il a change
+		const char* cacheDirectory;	// repertoire du cache, nullptr = a cote du fichier OBJ
+		bool optimizeVertexCache;	// reordonne triangles et sommets pour le cache post-transformation (cf. MeshOptimizer.h)
+		bool optimizeOverdraw;		// puis ordonne les clusters de triangles pour limiter l'overdraw (requiert optimizeVertexCache)
+		float overdrawThreshold;	// degradation maximale de l'ACMR toleree par OptimizeOverdraw (1.05 = 5%)
+		bool analyzeOverdraw;		// affiche l'overdraw estime avant/apres (cf. AnalyzeOverdraw, plusieurs centaines de ms)
+		bool shortIndices;			// indices 16 bits pour les SubMesh de moins de 65536 sommets
+		bool splitForShortIndices;	// decoupe les SubMesh plus grands afin qu'ils utilisent aussi des indices 16 bits
+		VertexFormat vertexFormat;	// VERTEX_PACKED : sommets quantifies de 20 octets (cf. PackedVertex)
+		bool generateNormals;		// genere les normales absentes du fichier (groupes de lissage, cf. NormalGenerator.h)
+		float creaseAngle;			// angle de pli en degres au-dela duquel deux faces ne sont pas lissees (180 = desactive)
+		uint32_t lodCount;			// nombre de LOD par SubMesh (au plus MAX_LOD_COUNT), 1 = pas de simplification
+		float lodReduction;			// rapport du nombre de triangles entre deux LOD successifs
+		float lodMaxError;			// erreur maximale d'un LOD, en fraction du rayon de la sphere englobante
+		bool buildMeshlets;			// decoupe le LOD 0 en meshlets pour l'elimination par le CPU (cf. BuildMeshlets)
+		bool compressTextures;		// textures des materiaux compressees en BC1/BC3, mises en cache (cf. TextureCache.h)
+		bool streamTextures;		// textures envoyees au GPU au fil des frames par TextureStreamer (a initialiser avant)
+
+		ParseOptions() : weldEpsilon(true), verbose(true), parallelLoad(false), threadCount(0), useCache(false), cacheDirectory(nullptr)
+			, optimizeVertexCache(false), optimizeOverdraw(false), overdrawThreshold(1.05f), analyzeOverdraw(false)
+			, shortIndices(false), splitForShortIndices(false), vertexFormat(VERTEX_FLOAT), generateNormals(false), creaseAngle(180.f)
+			, lodCount(1), lodReduction(0.5f), lodMaxError(0.1f), buildMeshlets(false)
+			, compressTextures(false), streamTextures(false) {}
+	};
 
 	void Destroy();
+	// regroupe les textures des materiaux en GL_TEXTURE_2D_ARRAY (cf. TextureArray.h) et rend les textures d'origine
+	// toutes les textures doivent etre entierement envoyees (TextureStreamer), retourne false si rien n'a ete regroupe
+	bool PackTextures();
+	// (re)ecrit materialUBO, arrondi a un multiple de MATERIALS_PER_BLOCK materiaux
+	void UploadMaterials();
 
-	static bool ParseObj(Mesh* obj, const char* filepath);
+	static bool ParseObj(Mesh* obj, const char* filepath, const ParseOptions& options = ParseOptions());
 };
 
 
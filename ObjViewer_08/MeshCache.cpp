@@ -0,0 +1,199 @@
+#include "MeshCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+static_assert(sizeof(MeshCache::Header) == 120, "le format du cache ne doit pas dependre du compilateur");
+static_assert(sizeof(MeshCache::SubMeshEntry) == 124, "le format du cache ne doit pas dependre du compilateur");
+static_assert(sizeof(Meshlet) == 40, "le format du cache ne doit pas dependre du compilateur");
+static_assert(sizeof(MeshCache::MaterialEntry) == 44, "le format du cache ne doit pas dependre du compilateur");
+
+static const uint64_t SECTION_ALIGNMENT = 16;
+
+static inline uint64_t AlignSection(uint64_t offset)
+{
+	return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+bool FileStamp::Get(const char* filepath, FileStamp* stamp)
+{
+#if defined(_WIN32)
+	struct _stat64 sb;
+	if (_stat64(filepath, &sb) != 0)
+		return false;
+#else
+	struct stat sb;
+	if (stat(filepath, &sb) != 0)
+		return false;
+#endif
+	stamp->size = (uint64_t)sb.st_size;
+	stamp->modificationTime = (int64_t)sb.st_mtime;
+	return true;
+}
+
+namespace MeshCache
+{
+	std::string PathFor(const char* sourcePath, const char* cacheDirectory)
+	{
+		std::string path = sourcePath;
+		size_t slash = path.find_last_of("/\\");
+		size_t dot = path.rfind('.');
+		if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+			path.resize(dot);
+		path += ".mesh";
+
+		if (cacheDirectory == nullptr)
+			return path;
+		// on ne garde que le nom du fichier
+		std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+		return std::string(cacheDirectory) + "/" + name;
+	}
+
+	uint32_t Builder::AddString(const std::string& str)
+	{
+		uint32_t offset = (uint32_t)strings.size();
+		strings.append(str.c_str(), str.size() + 1);
+		return offset;
+	}
+
+	void Builder::AddSubMesh(SubMeshEntry entry, const void* subVertices, const void* subIndices, const Meshlet* subMeshlets)
+	{
+		entry.firstVertex = uint32_t(vertexData.size() / vertexSize);
+		entry.indexOffset = (uint32_t)indexData.size();
+		entry.firstMeshlet = (uint32_t)meshlets.size();
+		subMeshes.push_back(entry);
+		if (entry.meshletCount)
+			meshlets.insert(meshlets.end(), subMeshlets, subMeshlets + entry.meshletCount);
+
+		const uint8_t* bytes = (const uint8_t*)subVertices;
+		vertexData.insert(vertexData.end(), bytes, bytes + size_t(vertexSize) * entry.verticesCount);
+		bytes = (const uint8_t*)subIndices;
+		indexData.insert(indexData.end(), bytes, bytes + size_t(entry.indexSize) * entry.indicesCount);
+		// chaque SubMesh debute sur 4 octets
+		indexData.resize((indexData.size() + 3) & ~size_t(3), 0);
+	}
+
+	bool Builder::Save(const char* cachePath, const FileStamp& source, uint64_t flags) const
+	{
+		Header header;
+		memset(&header, 0, sizeof(Header));
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.vertexSize = vertexSize;
+		header.flags = flags;
+		header.source = source;
+		header.subMeshCount = (uint32_t)subMeshes.size();
+		header.materialCount = (uint32_t)materials.size();
+		header.meshletCount = (uint32_t)meshlets.size();
+		header.vertexCount = vertexData.size() / vertexSize;
+		header.indexBytes = indexData.size();
+		header.stringSize = strings.size();
+		header.subMeshOffset = AlignSection(sizeof(Header));
+		header.materialOffset = AlignSection(header.subMeshOffset + sizeof(SubMeshEntry) * subMeshes.size());
+		header.vertexOffset = AlignSection(header.materialOffset + sizeof(MaterialEntry) * materials.size());
+		header.indexOffset = AlignSection(header.vertexOffset + vertexData.size());
+		header.stringOffset = AlignSection(header.indexOffset + indexData.size());
+		header.meshletOffset = AlignSection(header.stringOffset + strings.size());
+
+		std::string tempPath = std::string(cachePath) + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out)
+				return false;
+
+			uint64_t written = 0;
+			auto writeSection = [&](uint64_t offset, const void* data, size_t size) {
+				static const char zeros[SECTION_ALIGNMENT] = {};
+				out.write(zeros, offset - written);
+				if (size)
+					out.write((const char*)data, size);
+				written = offset + size;
+			};
+			writeSection(0, &header, sizeof(Header));
+			writeSection(header.subMeshOffset, subMeshes.data(), sizeof(SubMeshEntry) * subMeshes.size());
+			writeSection(header.materialOffset, materials.data(), sizeof(MaterialEntry) * materials.size());
+			writeSection(header.vertexOffset, vertexData.data(), vertexData.size());
+			writeSection(header.indexOffset, indexData.data(), indexData.size());
+			writeSection(header.stringOffset, strings.data(), strings.size());
+			writeSection(header.meshletOffset, meshlets.data(), sizeof(Meshlet) * meshlets.size());
+			if (!out) {
+				out.close();
+				std::remove(tempPath.c_str());
+				return false;
+			}
+		}
+
+		// std::rename ne remplace pas un fichier existant sous Windows
+		std::remove(cachePath);
+		return std::rename(tempPath.c_str(), cachePath) == 0;
+	}
+
+	bool Reader::Open(const char* cachePath, const FileStamp& source, uint64_t flags, uint32_t vertexSize)
+	{
+		if (!file.Open(cachePath))
+			return false;
+
+		header = nullptr;
+		if (file.size < sizeof(Header))
+			return false;
+		const Header* h = (const Header*)file.data;
+		if (h->magic != MAGIC || h->version != VERSION || h->vertexSize != vertexSize || h->flags != flags)
+			return false;
+		if (h->source.size != source.size || h->source.modificationTime != source.modificationTime)
+			return false;
+
+		// verification des bornes, un fichier tronque ne doit pas provoquer de lecture hors projection
+		auto inside = [&](uint64_t offset, uint64_t size) {
+			return offset <= file.size && size <= file.size - offset && (offset % SECTION_ALIGNMENT) == 0;
+		};
+		if (!inside(h->subMeshOffset, sizeof(SubMeshEntry) * (uint64_t)h->subMeshCount)
+			|| !inside(h->materialOffset, sizeof(MaterialEntry) * (uint64_t)h->materialCount)
+			|| !inside(h->vertexOffset, uint64_t(vertexSize) * h->vertexCount)
+			|| !inside(h->indexOffset, h->indexBytes)
+			|| !inside(h->stringOffset, h->stringSize)
+			|| !inside(h->meshletOffset, sizeof(Meshlet) * (uint64_t)h->meshletCount))
+			return false;
+		if (h->stringSize != 0 && file.data[h->stringOffset + h->stringSize - 1] != '\0')
+			return false;
+
+		subMeshes = (const SubMeshEntry*)(file.data + h->subMeshOffset);
+		materials = (const MaterialEntry*)(file.data + h->materialOffset);
+		vertexData = file.data + h->vertexOffset;
+		indexData = file.data + h->indexOffset;
+		strings = (const char*)(file.data + h->stringOffset);
+		meshlets = (const Meshlet*)(file.data + h->meshletOffset);
+
+		for (uint32_t i = 0; i < h->subMeshCount; i++) {
+			const SubMeshEntry& entry = subMeshes[i];
+			if ((uint64_t)entry.firstVertex + entry.verticesCount > h->vertexCount
+				|| (entry.indexSize != 2 && entry.indexSize != 4)
+				|| (uint64_t)entry.indexOffset + (uint64_t)entry.indexSize * entry.indicesCount > h->indexBytes
+				|| entry.materialId >= (int32_t)h->materialCount
+				|| entry.lodCount == 0 || entry.lodCount > MAX_LOD_COUNT
+				|| (uint64_t)entry.firstMeshlet + entry.meshletCount > h->meshletCount)
+				return false;
+			for (uint32_t m = 0; m < entry.meshletCount; m++) {
+				const Meshlet& meshlet = meshlets[entry.firstMeshlet + m];
+				if ((uint64_t)meshlet.firstIndex + meshlet.indicesCount > entry.lods[0].indicesCount)
+					return false;
+			}
+			for (uint32_t lod = 0; lod < entry.lodCount; lod++) {
+				const LodEntry& range = entry.lods[lod];
+				if (range.indexOffset % entry.indexSize != 0
+					|| (uint64_t)range.indexOffset + (uint64_t)entry.indexSize * range.indicesCount > (uint64_t)entry.indexSize * entry.indicesCount)
+					return false;
+			}
+		}
+		for (uint32_t i = 0; i < h->materialCount; i++) {
+			if (materials[i].diffuseTextureName >= h->stringSize)
+				return false;
+		}
+
+		header = h;
+		return true;
+	}
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Vertex.h"
+#include "MeshOptimizer.h"
+#include "MappedFile.h"
+
+// Cache binaire "cuisine" (cooked) d'un fichier OBJ
+// on stocke directement le resultat final de Mesh::ParseObj : sommets soudes, indices 16 ou 32 bits,
+// intervalles des SubMesh et table des materiaux (les textures sont stockees par leur nom).
+// Au lancement suivant le fichier .mesh est projete en memoire (cf. MappedFile) et les tableaux
+// sont passes tels quels a glBufferData, sans aucune analyse ni copie intermediaire.
+//
+// Organisation du fichier (chaque section est alignee sur 16 octets) :
+//   Header | SubMeshEntry[subMeshCount] | MaterialEntry[materialCount] | sommets (Vertex ou PackedVertex) | indices (16 ou 32 bits) | chaines
+//   | Meshlet[meshletCount]
+// les indices d'un SubMesh sont ceux de tous ses LOD, a la suite
+//
+// Le cache est invalide lorsque la taille ou la date de modification du fichier source changent,
+// lorsque le format (VERSION, taille des sommets) change ou lorsque les options de ParseObj sont differentes.
+// note: le fichier .mtl n'est pas surveille, il faut supprimer le .mesh apres l'avoir modifie
+
+// "empreinte" d'un fichier source
+struct FileStamp
+{
+	uint64_t size;
+	int64_t modificationTime;
+
+	static bool Get(const char* filepath, FileStamp* stamp);
+};
+
+namespace MeshCache
+{
+	static constexpr uint32_t MAGIC = 0x4853454d;	// "MESH" en little endian
+	static constexpr uint32_t VERSION = 8;				// 8 : couleurs des sommets de nouveau en sRGB (7 : RGB lineaire)
+	static constexpr uint32_t MAX_LOD_COUNT = 4;		// identique a ::MAX_LOD_COUNT (cf. Mesh.h)
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertexSize;		// sizeof(Vertex) ou sizeof(PackedVertex) au moment de l'ecriture
+		uint32_t subMeshCount;
+		uint64_t flags;				// options de ParseObj qui modifient le resultat
+		FileStamp source;
+		uint32_t materialCount;
+		uint32_t meshletCount;
+		uint64_t vertexCount;
+		uint64_t indexBytes;		// taille de la section des indices
+		uint64_t stringSize;
+		uint64_t subMeshOffset;		// offsets en octets depuis le debut du fichier
+		uint64_t materialOffset;
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		uint64_t stringOffset;
+		uint64_t meshletOffset;
+	};
+
+	struct LodEntry
+	{
+		uint32_t indexOffset;		// en octets depuis le premier indice du SubMesh
+		uint32_t indicesCount;
+		float error;
+	};
+
+	struct SubMeshEntry
+	{
+		uint32_t firstVertex;		// en nombre de sommets dans le tableau global
+		uint32_t verticesCount;
+		uint32_t indexOffset;		// en octets dans la section des indices
+		uint32_t indicesCount;		// total, tous LOD confondus
+		int32_t materialId;
+		uint32_t indexSize;			// 2 ou 4 octets
+		vec3 positionOffset;		// dequantification des positions (cf. SubMesh)
+		vec3 positionScale;
+		vec3 center;				// sphere englobante
+		float radius;
+		uint32_t lodCount;
+		LodEntry lods[MAX_LOD_COUNT];
+		uint32_t firstMeshlet;		// dans la section des meshlets
+		uint32_t meshletCount;
+	};
+
+	struct MaterialEntry
+	{
+		vec3 ambientColor;
+		vec3 diffuseColor;
+		vec3 specularColor;
+		float shininess;
+		uint32_t diffuseTextureName;	// offset dans la table des chaines (terminees par '\0')
+	};
+
+	// chemin du fichier cache : a cote du source (extension remplacee par .mesh)
+	// ou dans cacheDirectory si celui-ci est precise
+	std::string PathFor(const char* sourcePath, const char* cacheDirectory = nullptr);
+
+	// accumulation des donnees lors du chargement de l'OBJ puis ecriture du cache
+	struct Builder
+	{
+		std::vector<SubMeshEntry> subMeshes;
+		std::vector<MaterialEntry> materials;
+		std::vector<uint8_t> vertexData;
+		std::vector<uint8_t> indexData;
+		std::string strings;
+		std::vector<Meshlet> meshlets;
+		uint32_t vertexSize;
+
+		Builder() : vertexSize(sizeof(Vertex)) {}
+
+		uint32_t AddString(const std::string& str);
+		// entry decrit le SubMesh, firstVertex, indexOffset et firstMeshlet sont calcules ici
+		void AddSubMesh(SubMeshEntry entry, const void* subVertices, const void* subIndices, const Meshlet* subMeshlets = nullptr);
+
+		// ecrit d'abord un fichier temporaire puis le renomme, un cache incomplet n'est jamais lu
+		bool Save(const char* cachePath, const FileStamp& source, uint64_t flags) const;
+	};
+
+	// lecture "zero copie" : les pointeurs designent directement la projection memoire
+	// ils restent valides tant que le Reader existe
+	struct Reader
+	{
+		MappedFile file;
+		const Header* header;
+		const SubMeshEntry* subMeshes;
+		const MaterialEntry* materials;
+		const uint8_t* vertexData;
+		const uint8_t* indexData;
+		const char* strings;
+		const Meshlet* meshlets;
+
+		Reader() : header(nullptr), subMeshes(nullptr), materials(nullptr), vertexData(nullptr), indexData(nullptr), strings(nullptr)
+			, meshlets(nullptr) {}
+
+		// echoue si le fichier est absent, corrompu ou perime
+		bool Open(const char* cachePath, const FileStamp& source, uint64_t flags, uint32_t vertexSize = sizeof(Vertex));
+		const void* Vertices(const SubMeshEntry& entry) const { return vertexData + size_t(entry.firstVertex) * header->vertexSize; }
+		const void* Indices(const SubMeshEntry& entry) const { return indexData + entry.indexOffset; }
+		const char* String(uint32_t offset) const { return strings + offset; }
+	};
+}
@@ -0,0 +1,876 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+VertexCacheStatistics AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	VertexCacheStatistics stats = { 0, 0.f, 0.f };
+	if (indexCount == 0 || vertexCount == 0)
+		return stats;
+
+	// cache FIFO : un sommet est present si son horodatage est dans les cacheSize derniers ajouts
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t v = indices[i];
+		if (time - timestamps[v] > cacheSize) {
+			timestamps[v] = time++;
+			++stats.transformedVertices;
+		}
+	}
+
+	stats.acmr = float(stats.transformedVertices) / float(indexCount / 3);
+	stats.atvr = float(stats.transformedVertices) / float(vertexCount);
+	return stats;
+}
+
+// Tipsify : on "tourne" autour d'un sommet (fanning) en emettant tous ses triangles restants
+// puis on choisit comme prochain pivot un sommet des triangles emis qui sera encore dans le cache
+// une fois tous ses triangles emis. A defaut on depile les sommets recents (dead-end stack)
+// ou on prend le prochain sommet dans l'ordre d'origine
+void OptimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// on travaille sur une copie si la destination est aussi la source
+	std::vector<uint32_t> source;
+	if (destination == indices) {
+		source.assign(indices, indices + indexCount);
+		indices = source.data();
+	}
+
+	// adjacence sommet -> triangles (tableau compact, offsets par sommet)
+	std::vector<uint32_t> liveCount(vertexCount, 0);
+	for (size_t i = 0; i < indexCount; i++)
+		liveCount[indices[i]]++;
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + liveCount[v];
+	std::vector<uint32_t> adjacency(indexCount);
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indexCount; i++)
+			adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+	}
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnd;
+	deadEnd.reserve(indexCount);
+	std::vector<uint32_t> candidates;
+	candidates.reserve(64);
+
+	uint32_t time = cacheSize + 1;
+	size_t cursor = 0;			// prochain sommet a tester dans l'ordre d'origine
+	size_t outputCount = 0;
+	int64_t fanning = 0;
+
+	while (fanning >= 0)
+	{
+		candidates.clear();
+		const uint32_t f = uint32_t(fanning);
+		for (uint32_t a = offsets[f]; a < offsets[f + 1]; a++)
+		{
+			const uint32_t t = adjacency[a];
+			if (emitted[t])
+				continue;
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				const uint32_t v = indices[3 * t + k];
+				destination[outputCount++] = v;
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveCount[v]--;
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[t] = 1;
+		}
+
+		// prochain pivot : le sommet vivant le plus ancien qui restera dans le cache
+		int64_t next = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t v : candidates)
+		{
+			if (liveCount[v] == 0)
+				continue;
+			int64_t priority = 0;
+			if (int64_t(time) - cacheTime[v] + 2 * int64_t(liveCount[v]) <= int64_t(cacheSize))
+				priority = int64_t(time) - cacheTime[v];
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		if (next == -1)
+		{
+			// impasse : on depile les sommets recemment emis...
+			while (!deadEnd.empty()) {
+				uint32_t v = deadEnd.back();
+				deadEnd.pop_back();
+				if (liveCount[v] > 0) {
+					next = v;
+					break;
+				}
+			}
+			// ...sinon on reprend dans l'ordre d'origine
+			while (next == -1 && cursor < vertexCount) {
+				if (liveCount[cursor] > 0)
+					next = int64_t(cursor);
+				++cursor;
+			}
+		}
+		fanning = next;
+	}
+}
+
+uint32_t OptimizeVertexFetch(Vertex* vertices, uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+	static const uint32_t UNUSED = 0xffffffff;
+	std::vector<uint32_t> remap(vertexCount, UNUSED);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertexCount);
+
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t& index = indices[i];
+		if (remap[index] == UNUSED) {
+			remap[index] = uint32_t(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	if (!reordered.empty())
+		memcpy(vertices, reordered.data(), sizeof(Vertex) * reordered.size());
+	return uint32_t(reordered.size());
+}
+
+// simulation incrementale du cache FIFO, retourne le nombre de sommets du triangle absents du cache
+static inline uint32_t CacheMisses(const uint32_t* triangle, std::vector<uint32_t>& timestamps, uint32_t& time, uint32_t cacheSize)
+{
+	uint32_t misses = 0;
+	for (uint32_t k = 0; k < 3; k++) {
+		const uint32_t v = triangle[k];
+		if (time - timestamps[v] > cacheSize) {
+			timestamps[v] = time++;
+			++misses;
+		}
+	}
+	return misses;
+}
+
+// decoupe l'ordre d'entree en clusters de triangles contigus
+// 1. frontieres "dures" : triangles dont les trois sommets sont absents du cache
+//    (c'est la que Tipsify a du sauter vers une autre zone du mesh), decouper ici ne coute rien
+// 2. frontieres "souples" : on ferme un cluster des que son ACMR passe sous cutFactor x l'ACMR du mesh,
+//    le cache est vide a chaque coupure comme lors d'un saut de cluster
+static void SplitClusters(std::vector<uint32_t>& clusters, const uint32_t* indices, size_t triangleCount, size_t vertexCount,
+	float cutFactor, uint32_t cacheSize)
+{
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+	std::vector<uint32_t> hardClusters;
+	uint32_t totalMisses = 0;
+	for (size_t t = 0; t < triangleCount; t++) {
+		const uint32_t misses = CacheMisses(&indices[3 * t], timestamps, time, cacheSize);
+		if (t == 0 || misses == 3)
+			hardClusters.push_back(uint32_t(t));
+		totalMisses += misses;
+	}
+	hardClusters.push_back(uint32_t(triangleCount));
+
+	const float acmrThreshold = cutFactor * float(totalMisses) / float(triangleCount);
+	clusters.clear();
+	for (size_t h = 0; h + 1 < hardClusters.size(); h++)
+	{
+		const uint32_t start = hardClusters[h], end = hardClusters[h + 1];
+		time += cacheSize + 1;
+		uint32_t clusterStart = start;
+		uint32_t clusterMisses = 0;
+		clusters.push_back(start);
+		for (uint32_t t = start; t < end; t++)
+		{
+			clusterMisses += CacheMisses(&indices[3 * t], timestamps, time, cacheSize);
+			if (t + 1 < end && float(clusterMisses) <= acmrThreshold * float(t + 1 - clusterStart)) {
+				clusterStart = t + 1;
+				clusterMisses = 0;
+				time += cacheSize + 1;
+				clusters.push_back(clusterStart);
+			}
+		}
+	}
+	clusters.push_back(uint32_t(triangleCount));
+}
+
+// ecrit les clusters dans destination, du plus "exterieur" au plus "interieur"
+static void SortClusters(uint32_t* destination, const uint32_t* indices, const std::vector<uint32_t>& clusters, const Vertex* vertices)
+{
+	const size_t clusterCount = clusters.size() - 1;
+
+	// position et normale moyennes (ponderees par l'aire) de chaque cluster
+	// les clusters orientes vers l'exterieur du mesh sont dessines en premier
+	std::vector<vec3> centroids(clusterCount), normals(clusterCount);
+	vec3 meshCentroid = { 0.f, 0.f, 0.f };
+	float meshArea = 0.f;
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		vec3 centroid = { 0.f, 0.f, 0.f }, normal = { 0.f, 0.f, 0.f };
+		float clusterArea = 0.f;
+		for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			const vec3& a = vertices[indices[3 * t + 0]].position;
+			const vec3& b = vertices[indices[3 * t + 1]].position;
+			const vec3& d = vertices[indices[3 * t + 2]].position;
+			const vec3 ab = { b.x - a.x, b.y - a.y, b.z - a.z };
+			const vec3 ad = { d.x - a.x, d.y - a.y, d.z - a.z };
+			const vec3 n = { ab.y * ad.z - ab.z * ad.y, ab.z * ad.x - ab.x * ad.z, ab.x * ad.y - ab.y * ad.x };
+			const float area = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+			centroid.x += area * (a.x + b.x + d.x) / 3.f;
+			centroid.y += area * (a.y + b.y + d.y) / 3.f;
+			centroid.z += area * (a.z + b.z + d.z) / 3.f;
+			normal.x += n.x; normal.y += n.y; normal.z += n.z;
+			clusterArea += area;
+		}
+		meshCentroid.x += centroid.x; meshCentroid.y += centroid.y; meshCentroid.z += centroid.z;
+		meshArea += clusterArea;
+		const float invArea = clusterArea > 0.f ? 1.f / clusterArea : 0.f;
+		centroids[c] = { centroid.x * invArea, centroid.y * invArea, centroid.z * invArea };
+		const float length = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+		const float invLength = length > 0.f ? 1.f / length : 0.f;
+		normals[c] = { normal.x * invLength, normal.y * invLength, normal.z * invLength };
+	}
+	if (meshArea > 0.f) {
+		meshCentroid.x /= meshArea; meshCentroid.y /= meshArea; meshCentroid.z /= meshArea;
+	}
+
+	std::vector<float> sortKeys(clusterCount);
+	std::vector<uint32_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) {
+		sortKeys[c] = (centroids[c].x - meshCentroid.x) * normals[c].x + (centroids[c].y - meshCentroid.y) * normals[c].y
+			+ (centroids[c].z - meshCentroid.z) * normals[c].z;
+		order[c] = uint32_t(c);
+	}
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	size_t outputCount = 0;
+	for (uint32_t c : order) {
+		const size_t count = 3 * size_t(clusters[c + 1] - clusters[c]);
+		memcpy(destination + outputCount, indices + 3 * size_t(clusters[c]), count * sizeof(uint32_t));
+		outputCount += count;
+	}
+}
+
+void OptimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+	float threshold, uint32_t cacheSize)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	std::vector<uint32_t> source;
+	if (destination == indices) {
+		source.assign(indices, indices + indexCount);
+		indices = source.data();
+	}
+
+	// on verifie que le resultat respecte le seuil, sinon on recommence avec des clusters plus grands
+	// (le dernier essai ne garde que les frontieres dures) et en dernier recours on conserve l'ordre d'entree
+	const float maxTransformed = threshold * float(AnalyzeVertexCache(indices, indexCount, vertexCount, cacheSize).transformedVertices);
+	std::vector<uint32_t> clusters;
+	std::vector<uint32_t> output(indexCount);
+	float cutFactor = threshold;
+	for (int attempt = 0; attempt < 8; attempt++)
+	{
+		if (attempt == 7)
+			cutFactor = 0.f;
+		SplitClusters(clusters, indices, triangleCount, vertexCount, cutFactor, cacheSize);
+		SortClusters(output.data(), indices, clusters, vertices);
+		if (float(AnalyzeVertexCache(output.data(), indexCount, vertexCount, cacheSize).transformedVertices) <= maxTransformed) {
+			memcpy(destination, output.data(), indexCount * sizeof(uint32_t));
+			return;
+		}
+		cutFactor *= 0.75f;
+	}
+	if (destination != indices)
+		memcpy(destination, indices, indexCount * sizeof(uint32_t));
+}
+
+OverdrawStatistics AnalyzeOverdraw(const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+	uint32_t viewCount, uint32_t resolution)
+{
+	OverdrawStatistics stats = { 0, 0, 0.f };
+	if (indexCount < 3 || vertexCount == 0)
+		return stats;
+
+	// sphere englobante (approximative) des sommets
+	vec3 minimum = vertices[indices[0]].position, maximum = minimum;
+	for (size_t i = 0; i < indexCount; i++) {
+		const vec3& p = vertices[indices[i]].position;
+		minimum = { std::min(minimum.x, p.x), std::min(minimum.y, p.y), std::min(minimum.z, p.z) };
+		maximum = { std::max(maximum.x, p.x), std::max(maximum.y, p.y), std::max(maximum.z, p.z) };
+	}
+	const vec3 center = { (minimum.x + maximum.x) * 0.5f, (minimum.y + maximum.y) * 0.5f, (minimum.z + maximum.z) * 0.5f };
+	float radius = 0.f;
+	for (size_t i = 0; i < indexCount; i++) {
+		const vec3& p = vertices[indices[i]].position;
+		radius = std::max(radius, sqrtf((p.x - center.x) * (p.x - center.x) + (p.y - center.y) * (p.y - center.y) + (p.z - center.z) * (p.z - center.z)));
+	}
+	if (radius <= 0.f)
+		return stats;
+
+	std::vector<float> depthBuffer(resolution * resolution);
+	std::vector<vec3> projected(vertexCount);
+	const float scale = 0.5f * float(resolution) / radius;
+
+	for (uint32_t view = 0; view < viewCount; view++)
+	{
+		// directions reparties uniformement sur la sphere (spirale de Fibonacci)
+		const float z = 1.f - (2.f * view + 1.f) / float(viewCount);
+		const float r = sqrtf(std::max(0.f, 1.f - z * z));
+		const float phi = float(view) * 2.39996323f;
+		const vec3 forward = { r * cosf(phi), r * sinf(phi), z };	// de la cible vers la camera
+		// repere direct (right, up, forward)
+		const vec3 upRef = fabsf(forward.y) < 0.99f ? vec3{ 0.f, 1.f, 0.f } : vec3{ 1.f, 0.f, 0.f };
+		vec3 right = { upRef.y * forward.z - upRef.z * forward.y, upRef.z * forward.x - upRef.x * forward.z, upRef.x * forward.y - upRef.y * forward.x };
+		const float rightLength = sqrtf(right.x * right.x + right.y * right.y + right.z * right.z);
+		right = { right.x / rightLength, right.y / rightLength, right.z / rightLength };
+		const vec3 up = { forward.y * right.z - forward.z * right.y, forward.z * right.x - forward.x * right.z, forward.x * right.y - forward.y * right.x };
+
+		for (size_t v = 0; v < vertexCount; v++) {
+			const vec3 p = { vertices[v].position.x - center.x, vertices[v].position.y - center.y, vertices[v].position.z - center.z };
+			projected[v] = { (p.x * right.x + p.y * right.y + p.z * right.z) * scale + 0.5f * resolution,
+				(p.x * up.x + p.y * up.y + p.z * up.z) * scale + 0.5f * resolution,
+				p.x * forward.x + p.y * forward.y + p.z * forward.z };	// plus grand = plus proche
+		}
+
+		std::fill(depthBuffer.begin(), depthBuffer.end(), -FLT_MAX);
+		for (size_t t = 0; t + 2 < indexCount; t += 3)
+		{
+			const vec3& a = projected[indices[t + 0]];
+			const vec3& b = projected[indices[t + 1]];
+			const vec3& c = projected[indices[t + 2]];
+			// aire signee, les faces horaires (arrieres) sont eliminees
+			const float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+			if (area <= 0.f)
+				continue;
+			const float invArea = 1.f / area;
+
+			const int x0 = std::max(0, int(floorf(std::min(a.x, std::min(b.x, c.x)))));
+			const int x1 = std::min(int(resolution) - 1, int(ceilf(std::max(a.x, std::max(b.x, c.x)))));
+			const int y0 = std::max(0, int(floorf(std::min(a.y, std::min(b.y, c.y)))));
+			const int y1 = std::min(int(resolution) - 1, int(ceilf(std::max(a.y, std::max(b.y, c.y)))));
+			for (int y = y0; y <= y1; y++)
+			{
+				const float py = y + 0.5f;
+				for (int x = x0; x <= x1; x++)
+				{
+					const float px = x + 0.5f;
+					// fonctions d'aretes (coordonnees barycentriques non normalisees)
+					const float w0 = (c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x);
+					const float w1 = (a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x);
+					const float w2 = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+					if (w0 < 0.f || w1 < 0.f || w2 < 0.f)
+						continue;
+					const float depth = (w0 * a.z + w1 * b.z + w2 * c.z) * invArea;
+					float& stored = depthBuffer[y * resolution + x];
+					if (depth > stored) {
+						stored = depth;
+						++stats.pixelsShaded;
+					}
+				}
+			}
+		}
+
+		for (float depth : depthBuffer)
+			stats.pixelsCovered += (depth != -FLT_MAX) ? 1 : 0;
+	}
+
+	stats.overdraw = stats.pixelsCovered ? float(stats.pixelsShaded) / float(stats.pixelsCovered) : 0.f;
+	return stats;
+}
+
+void SplitMesh(std::vector<MeshPart>& parts, const Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+	uint32_t maxVertices)
+{
+	static const uint32_t UNUSED = 0xffffffff;
+	// remap[v] : indice local du sommet v dans la partie courante
+	std::vector<uint32_t> remap(vertexCount, UNUSED);
+	std::vector<uint32_t> used;		// sommets d'origine de la partie courante
+	parts.clear();
+	parts.emplace_back();
+
+	for (size_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		MeshPart* part = &parts.back();
+		uint32_t missing = 0;
+		for (size_t k = 0; k < 3; k++)
+			missing += (remap[indices[t + k]] == UNUSED) ? 1 : 0;
+
+		// le triangle ne tient plus dans la partie courante, on en commence une nouvelle
+		if (part->vertices.size() + missing > maxVertices)
+		{
+			for (const uint32_t v : used)
+				remap[v] = UNUSED;
+			used.clear();
+			parts.emplace_back();
+			part = &parts.back();
+		}
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			const uint32_t v = indices[t + k];
+			if (remap[v] == UNUSED) {
+				remap[v] = uint32_t(part->vertices.size());
+				part->vertices.push_back(vertices[v]);
+				used.push_back(v);
+			}
+			part->indices.push_back(remap[v]);
+		}
+	}
+}
+
+// quadrique d'erreur : Q(p) = somme des carres des distances de p a un ensemble de plans
+// Q(p) = p^T A p + 2 b.p + c, avec A symetrique (6 coefficients)
+struct Quadric
+{
+	double a00, a01, a02, a11, a12, a22;
+	double b0, b1, b2;
+	double c;
+};
+
+// plan n.p + d = 0, n unitaire
+static inline void AddPlane(Quadric& q, double nx, double ny, double nz, double d)
+{
+	q.a00 += nx * nx; q.a01 += nx * ny; q.a02 += nx * nz;
+	q.a11 += ny * ny; q.a12 += ny * nz; q.a22 += nz * nz;
+	q.b0 += nx * d; q.b1 += ny * d; q.b2 += nz * d;
+	q.c += d * d;
+}
+
+static inline void AddQuadric(Quadric& q, const Quadric& r)
+{
+	q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02;
+	q.a11 += r.a11; q.a12 += r.a12; q.a22 += r.a22;
+	q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+	q.c += r.c;
+}
+
+static inline double EvaluateQuadric(const Quadric& q, const vec3& p)
+{
+	const double x = p.x, y = p.y, z = p.z;
+	const double result = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+		+ 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+		+ 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+	// les erreurs d'arrondi peuvent donner un resultat (tres legerement) negatif
+	return result > 0.0 ? result : 0.0;
+}
+
+static inline vec3 TriangleNormal(const vec3& a, const vec3& b, const vec3& c)
+{
+	const vec3 e1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+	const vec3 e2 = { c.x - a.x, c.y - a.y, c.z - a.z };
+	return { e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x };
+}
+
+// un sommet "canonique" par position distincte : les sommets d'une couture (uv, normales)
+// partagent la meme position mais sont des sommets differents de l'index buffer
+static void ComputeCanonicalVertices(std::vector<uint32_t>& canonical, const Vertex* vertices, size_t vertexCount)
+{
+	struct PositionKey
+	{
+		uint32_t x, y, z;
+		bool operator==(const PositionKey& rhs) const { return x == rhs.x && y == rhs.y && z == rhs.z; }
+	};
+	struct PositionHash
+	{
+		size_t operator()(const PositionKey& k) const { return (k.x * 73856093u) ^ (k.y * 19349663u) ^ (k.z * 83492791u); }
+	};
+	canonical.resize(vertexCount);
+	std::unordered_map<PositionKey, uint32_t, PositionHash> positions;
+	positions.reserve(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		PositionKey key;
+		memcpy(&key, &vertices[v].position, sizeof(PositionKey));
+		canonical[v] = positions.insert({ key, uint32_t(v) }).first->second;
+	}
+}
+
+size_t SimplifyMesh(uint32_t* destination, const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+	size_t targetIndexCount, float maxError, float* resultError)
+{
+	if (resultError)
+		*resultError = 0.f;
+
+	// 1. positions canoniques
+	std::vector<uint32_t> canonical;
+	ComputeCanonicalVertices(canonical, vertices, vertexCount);
+
+	// les triangles degeneres (deux coins a la meme position) sont ignores des le depart
+	std::vector<uint32_t> current;
+	current.reserve(indexCount);
+	for (size_t i = 0; i + 2 < indexCount; i += 3) {
+		const uint32_t a = canonical[indices[i + 0]], b = canonical[indices[i + 1]], c = canonical[indices[i + 2]];
+		if (a != b && b != c && a != c)
+			current.insert(current.end(), indices + i, indices + i + 3);
+	}
+
+	// 2. bords : une arete (canonique) qui n'est pas partagee par exactement deux triangles de sens opposes
+	// verrouille ses extremites. C'est en particulier le cas des frontieres entre SubMesh (materiaux)
+	std::vector<uint8_t> locked(vertexCount, 0);
+	{
+		std::unordered_map<uint64_t, uint32_t> edges;
+		edges.reserve(current.size());
+		auto EdgeKey = [](uint32_t a, uint32_t b) { return (uint64_t(a) << 32) | b; };
+		for (size_t i = 0; i < current.size(); i += 3)
+			for (size_t k = 0; k < 3; k++)
+				edges[EdgeKey(canonical[current[i + k]], canonical[current[i + (k + 1) % 3]])]++;
+		for (size_t i = 0; i < current.size(); i += 3) {
+			for (size_t k = 0; k < 3; k++) {
+				const uint32_t a = canonical[current[i + k]], b = canonical[current[i + (k + 1) % 3]];
+				auto reverse = edges.find(EdgeKey(b, a));
+				if (edges[EdgeKey(a, b)] != 1 || reverse == edges.end() || reverse->second != 1)
+					locked[a] = locked[b] = 1;
+			}
+		}
+	}
+
+	// 3. quadriques des plans des triangles adjacents a chaque position
+	std::vector<Quadric> quadrics(vertexCount);
+	memset(quadrics.data(), 0, sizeof(Quadric) * vertexCount);
+	for (size_t i = 0; i < current.size(); i += 3)
+	{
+		const vec3& p0 = vertices[current[i + 0]].position;
+		const vec3 n = TriangleNormal(p0, vertices[current[i + 1]].position, vertices[current[i + 2]].position);
+		const double length = sqrt(double(n.x) * n.x + double(n.y) * n.y + double(n.z) * n.z);
+		if (length == 0.0)
+			continue;
+		const double nx = n.x / length, ny = n.y / length, nz = n.z / length;
+		const double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+		for (size_t k = 0; k < 3; k++)
+			AddPlane(quadrics[canonical[current[i + k]]], nx, ny, nz, d);
+	}
+
+	// 4. passes successives : on trie les fusions candidates par cout croissant puis on applique
+	// un ensemble de fusions independantes (les voisinages ne se recouvrent pas)
+	struct Collapse
+	{
+		uint32_t from, to;	// positions canoniques
+		double cost;
+	};
+	const double maxCost = double(maxError) * double(maxError);
+	double worstCost = 0.0;
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<uint8_t> touched(vertexCount);
+	std::vector<uint32_t> offsets(vertexCount + 1);
+	std::vector<uint32_t> fans;
+	std::vector<Collapse> collapses;
+	std::vector<std::pair<uint32_t, uint32_t>> pairs;		// (sommet supprime, sommet cible) d'une fusion
+
+	while (current.size() > targetIndexCount)
+	{
+		const size_t triangleCount = current.size() / 3;
+
+		// triangles adjacents a chaque position canonique
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (size_t i = 0; i < current.size(); i++)
+			offsets[canonical[current[i]] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			offsets[v + 1] += offsets[v];
+		fans.resize(current.size());
+		{
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < current.size(); i++)
+				fans[fill[canonical[current[i]]]++] = uint32_t(i / 3);
+		}
+
+		// chaque arete donne deux candidats (un par sens), le sommet conserve est toujours un sommet existant
+		collapses.clear();
+		for (size_t t = 0; t < triangleCount; t++) {
+			for (size_t k = 0; k < 3; k++) {
+				const uint32_t a = canonical[current[3 * t + k]], b = canonical[current[3 * t + (k + 1) % 3]];
+				const vec3& pa = vertices[a].position;
+				const vec3& pb = vertices[b].position;
+				if (!locked[a])
+					collapses.push_back({ a, b, EvaluateQuadric(quadrics[a], pb) + EvaluateQuadric(quadrics[b], pb) });
+				if (!locked[b])
+					collapses.push_back({ b, a, EvaluateQuadric(quadrics[a], pa) + EvaluateQuadric(quadrics[b], pa) });
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) { return lhs.cost < rhs.cost; });
+
+		for (size_t v = 0; v < vertexCount; v++)
+			remap[v] = uint32_t(v);
+		std::fill(touched.begin(), touched.end(), 0);
+		const size_t needed = (current.size() - targetIndexCount + 2) / 3;
+		size_t removed = 0;
+		bool applied = false;
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapse.cost > maxCost || removed >= needed)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			const uint32_t* fanBegin = fans.data() + offsets[collapse.from];
+			const uint32_t* fanEnd = fans.data() + offsets[collapse.from + 1];
+
+			// correspondance des sommets de couture : chaque sommet a la position "from" doit avoir un sommet
+			// a la position "to" dans l'un de ses triangles, sinon la couture serait deformee
+			pairs.clear();
+			size_t collapsedTriangles = 0;
+			for (const uint32_t* t = fanBegin; t != fanEnd; ++t) {
+				const uint32_t* triangle = &current[3 * *t];
+				uint32_t u = UINT32_MAX, v = UINT32_MAX;
+				for (size_t k = 0; k < 3; k++) {
+					if (canonical[triangle[k]] == collapse.from) u = triangle[k];
+					if (canonical[triangle[k]] == collapse.to) v = triangle[k];
+				}
+				if (v == UINT32_MAX)
+					continue;
+				++collapsedTriangles;
+				bool known = false;
+				for (const auto& pair : pairs)
+					known |= (pair.first == u);
+				if (!known)
+					pairs.push_back({ u, v });
+			}
+
+			bool valid = true;
+			for (const uint32_t* t = fanBegin; t != fanEnd && valid; ++t)
+			{
+				const uint32_t* triangle = &current[3 * *t];
+				bool hasTarget = false, mapped = false;
+				vec3 p[3];
+				for (size_t k = 0; k < 3; k++)
+				{
+					const uint32_t c = canonical[triangle[k]];
+					hasTarget |= (c == collapse.to);
+					p[k] = vertices[triangle[k]].position;
+					if (c == collapse.from) {
+						for (const auto& pair : pairs)
+							mapped |= (pair.first == triangle[k]);
+						p[k] = vertices[collapse.to].position;
+					}
+				}
+				if (!mapped)
+					valid = false;
+				else if (!hasTarget)
+				{
+					// le triangle ne doit pas se retourner
+					const vec3 before = TriangleNormal(vertices[triangle[0]].position, vertices[triangle[1]].position, vertices[triangle[2]].position);
+					const vec3 after = TriangleNormal(p[0], p[1], p[2]);
+					if (before.x * after.x + before.y * after.y + before.z * after.z <= 0.f)
+						valid = false;
+				}
+			}
+			if (!valid)
+				continue;
+
+			for (const auto& pair : pairs)
+				remap[pair.first] = pair.second;
+			AddQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			// le voisinage est fige jusqu'a la passe suivante
+			for (const uint32_t* t = fanBegin; t != fanEnd; ++t)
+				for (size_t k = 0; k < 3; k++)
+					touched[canonical[current[3 * *t + k]]] = 1;
+			removed += collapsedTriangles;
+			worstCost = std::max(worstCost, collapse.cost);
+			applied = true;
+		}
+		if (!applied)
+			break;
+
+		// reecriture de l'index buffer, les triangles reduits a une arete disparaissent
+		size_t write = 0;
+		for (size_t i = 0; i < current.size(); i += 3) {
+			const uint32_t a = remap[current[i + 0]], b = remap[current[i + 1]], c = remap[current[i + 2]];
+			if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[a] == canonical[c])
+				continue;
+			current[write++] = a;
+			current[write++] = b;
+			current[write++] = c;
+		}
+		current.resize(write);
+	}
+
+	if (resultError)
+		*resultError = float(sqrt(worstCost));
+	std::copy(current.begin(), current.end(), destination);
+	return current.size();
+}
+
+// sphere (centre de la boite englobante) et cone des normales des triangles [first, first + count[
+static void ComputeMeshletBounds(Meshlet& meshlet, const uint32_t* indices, const Vertex* vertices)
+{
+	const uint32_t* begin = indices + meshlet.firstIndex;
+	const uint32_t* end = begin + meshlet.indicesCount;
+
+	vec3 minimum = vertices[*begin].position, maximum = minimum;
+	for (const uint32_t* i = begin; i != end; ++i) {
+		const vec3& p = vertices[*i].position;
+		minimum = { std::min(minimum.x, p.x), std::min(minimum.y, p.y), std::min(minimum.z, p.z) };
+		maximum = { std::max(maximum.x, p.x), std::max(maximum.y, p.y), std::max(maximum.z, p.z) };
+	}
+	meshlet.center = { (minimum.x + maximum.x) * 0.5f, (minimum.y + maximum.y) * 0.5f, (minimum.z + maximum.z) * 0.5f };
+	float squaredRadius = 0.f;
+	for (const uint32_t* i = begin; i != end; ++i) {
+		const vec3& p = vertices[*i].position;
+		const vec3 d = { p.x - meshlet.center.x, p.y - meshlet.center.y, p.z - meshlet.center.z };
+		squaredRadius = std::max(squaredRadius, d.x * d.x + d.y * d.y + d.z * d.z);
+	}
+	meshlet.radius = sqrtf(squaredRadius);
+
+	// axe : moyenne des normales (ponderees par l'aire), ouverture : plus grand ecart a l'axe
+	std::vector<vec3> normals;
+	normals.reserve(meshlet.indicesCount / 3);
+	vec3 axis = { 0.f, 0.f, 0.f };
+	for (const uint32_t* i = begin; i + 2 < end; i += 3) {
+		const vec3 n = TriangleNormal(vertices[i[0]].position, vertices[i[1]].position, vertices[i[2]].position);
+		const float length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+		if (length == 0.f)
+			continue;
+		axis = { axis.x + n.x, axis.y + n.y, axis.z + n.z };
+		normals.push_back({ n.x / length, n.y / length, n.z / length });
+	}
+	const float axisLength = sqrtf(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+	meshlet.coneAxis = { 0.f, 0.f, 0.f };
+	meshlet.coneCutoff = 1.f;
+	if (axisLength == 0.f || normals.empty())
+		return;
+	meshlet.coneAxis = { axis.x / axisLength, axis.y / axisLength, axis.z / axisLength };
+	float minimumDot = 1.f;
+	for (const vec3& n : normals)
+		minimumDot = std::min(minimumDot, n.x * meshlet.coneAxis.x + n.y * meshlet.coneAxis.y + n.z * meshlet.coneAxis.z);
+	// au-dela d'un demi-espace (ou presque) le cone n'elimine plus rien
+	if (minimumDot <= 0.1f)
+		return;
+	meshlet.coneCutoff = sqrtf(1.f - minimumDot * minimumDot);
+}
+
+void BuildMeshlets(std::vector<Meshlet>& meshlets, uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+	uint32_t maxVertices, uint32_t maxTriangles)
+{
+	meshlets.clear();
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+	const std::vector<uint32_t> source(indices, indices + triangleCount * 3);
+
+	// adjacence position -> triangles, par positions canoniques afin de traverser les coutures (uv, normales)
+	std::vector<uint32_t> canonical;
+	ComputeCanonicalVertices(canonical, vertices, vertexCount);
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		offsets[canonical[source[i]] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] += offsets[v];
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			adjacency[fill[canonical[source[i]]]++] = uint32_t(i / 3);
+	}
+
+	std::vector<vec3> normals(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++) {
+		const vec3 n = TriangleNormal(vertices[source[3 * t]].position, vertices[source[3 * t + 1]].position, vertices[source[3 * t + 2]].position);
+		const float length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+		normals[t] = length > 0.f ? vec3{ n.x / length, n.y / length, n.z / length } : vec3{ 0.f, 0.f, 0.f };
+	}
+
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	// marque des sommets du meshlet courant (numero du meshlet + 1)
+	std::vector<uint32_t> owner(vertexCount, 0);
+	std::vector<uint32_t> meshletVertices;
+	meshletVertices.reserve(maxVertices);
+	size_t write = 0;
+	size_t seed = 0;
+
+	while (write < triangleCount * 3)
+	{
+		// germe : premier triangle restant dans l'ordre d'entree
+		while (emitted[seed])
+			++seed;
+		const uint32_t id = uint32_t(meshlets.size()) + 1;
+		Meshlet meshlet = {};
+		meshlet.firstIndex = uint32_t(write);
+		meshletVertices.clear();
+		vec3 axis = { 0.f, 0.f, 0.f };
+
+		size_t next = seed;
+		while (next != SIZE_MAX)
+		{
+			const uint32_t* triangle = &source[3 * next];
+			for (size_t k = 0; k < 3; k++) {
+				if (owner[triangle[k]] != id) {
+					owner[triangle[k]] = id;
+					meshletVertices.push_back(triangle[k]);
+				}
+				indices[write++] = triangle[k];
+			}
+			emitted[next] = 1;
+			meshlet.indicesCount += 3;
+			axis = { axis.x + normals[next].x, axis.y + normals[next].y, axis.z + normals[next].z };
+			if (meshlet.indicesCount / 3 >= maxTriangles)
+				break;
+
+			// triangle suivant parmi ceux qui touchent le meshlet : le moins de nouveaux sommets possible,
+			// puis la normale la plus proche de celle du meshlet (cone etroit, meilleure elimination de dos)
+			const float axisLength = sqrtf(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+			next = SIZE_MAX;
+			uint32_t bestMissing = 4;
+			float bestDot = -FLT_MAX;
+			for (const uint32_t vertex : meshletVertices)
+			{
+				const uint32_t v = canonical[vertex];
+				for (uint32_t a = offsets[v]; a < offsets[v + 1]; a++)
+				{
+					const uint32_t t = adjacency[a];
+					if (emitted[t])
+						continue;
+					uint32_t missing = 0;
+					for (size_t k = 0; k < 3; k++)
+						missing += (owner[source[3 * t + k]] != id) ? 1 : 0;
+					if (meshletVertices.size() + missing > maxVertices)
+						continue;
+					const float dot = axisLength > 0.f
+						? (normals[t].x * axis.x + normals[t].y * axis.y + normals[t].z * axis.z) / axisLength : 0.f;
+					if (missing < bestMissing || (missing == bestMissing && dot > bestDot)) {
+						next = t;
+						bestMissing = missing;
+						bestDot = dot;
+					}
+				}
+			}
+			// plus de voisin (composante connexe epuisee) : on poursuit avec le triangle suivant dans l'ordre d'entree
+			// s'il tient encore dans le meshlet et reste oriente comme lui, plutot que de produire de nombreux petits meshlets
+			if (next == SIZE_MAX && axisLength > 0.f)
+			{
+				while (seed < triangleCount && emitted[seed])
+					++seed;
+				if (seed < triangleCount) {
+					uint32_t missing = 0;
+					for (size_t k = 0; k < 3; k++)
+						missing += (owner[source[3 * seed + k]] != id) ? 1 : 0;
+					const float dot = (normals[seed].x * axis.x + normals[seed].y * axis.y + normals[seed].z * axis.z) / axisLength;
+					if (meshletVertices.size() + missing <= maxVertices && dot >= 0.7f)
+						next = seed;
+				}
+			}
+		}
+
+		ComputeMeshletBounds(meshlet, indices, vertices);
+		meshlets.push_back(meshlet);
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "Vertex.h"
+
+// Optimisations des index/vertex buffers apres la soudure des sommets (cf. Mesh::ParseObj)
+//
+// Le GPU conserve les derniers sommets transformes par le vertex shader dans un petit cache
+// (post-transform vertex cache). Un indice deja present dans le cache n'est pas retransforme.
+// L'ordre des faces d'un OBJ ne tient pas compte de ce cache, on reordonne donc les triangles
+// puis les sommets (localite des lectures en memoire video).
+
+// taille du cache FIFO simule, valeur classique des GPU "desktop"
+static const uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStatistics
+{
+	uint32_t transformedVertices;	// nombre d'executions du vertex shader
+	float acmr;		// average cache miss ratio : sommets transformes par triangle (0.5 ideal, 3 pire cas)
+	float atvr;		// average transform to vertex ratio : sommets transformes par sommet (1 ideal)
+};
+
+// simulation d'un cache FIFO de cacheSize entrees
+VertexCacheStatistics AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// reordonne les triangles pour la localite dans le cache (algorithme Tipsify, Sander et al. 2007)
+// temps lineaire, destination peut etre egal a indices
+void OptimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// renumerote les sommets dans l'ordre de leur premiere utilisation par l'index buffer
+// les sommets inutilises sont supprimes, retourne le nouveau nombre de sommets
+uint32_t OptimizeVertexFetch(Vertex* vertices, uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+// reordonne les triangles (deja optimises par OptimizeVertexCache) pour reduire l'overdraw
+// les triangles sont groupes en clusters contigus puis les clusters tournes vers l'exterieur du mesh
+// sont dessines en premier, ils masquent ainsi les clusters situes derriere eux (Sander et al. 2007).
+// threshold borne la degradation de l'efficacite du cache : 1.05 autorise 5% de sommets transformes
+// en plus que l'ordre d'entree, une valeur plus elevee produit plus de clusters (et moins d'overdraw)
+void OptimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+	float threshold = 1.05f, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+struct OverdrawStatistics
+{
+	uint64_t pixelsCovered;		// pixels couverts a la fin du rendu
+	uint64_t pixelsShaded;		// executions du fragment shader (test de profondeur reussi)
+	float overdraw;				// pixelsShaded / pixelsCovered (1 ideal)
+};
+
+// estimation de l'overdraw par rasterisation logicielle (depth test + back face culling CCW comme la passe opaque)
+// depuis viewCount points de vue repartis sur la sphere englobante, en projection orthographique
+OverdrawStatistics AnalyzeOverdraw(const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+	uint32_t viewCount = 16, uint32_t resolution = 256);
+
+// simplification par fusion d'aretes (edge collapse) guidee par des quadriques d'erreur (Garland & Heckbert 1997)
+// une position est toujours fusionnee sur une position voisine existante : le resultat est un nouvel index buffer
+// qui reutilise les sommets d'origine, toute une chaine de LOD peut ainsi partager le meme vertex buffer.
+// Les positions de bord (frontieres entre materiaux/SubMesh, bords ouverts) ne sont jamais deplacees
+// et les coutures (uv, normales) ne sont fusionnees que le long de la couture elle-meme.
+// s'arrete a targetIndexCount indices ou lorsque la prochaine fusion depasserait maxError (distance, unites du modele)
+// retourne le nombre d'indices ecrits dans destination (au plus indexCount), error recoit l'erreur atteinte
+size_t SimplifyMesh(uint32_t* destination, const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+	size_t targetIndexCount, float maxError, float* error = nullptr);
+
+// meshlet : suite contigue de triangles de l'index buffer (LOD 0) d'un SubMesh
+// suffisamment petite pour etre eliminee individuellement par le CPU (hors champ ou tournee vers l'arriere)
+static const uint32_t MESHLET_MAX_VERTICES = 64;
+static const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet
+{
+	uint32_t firstIndex;	// en nombre d'indices depuis le debut de l'index buffer du SubMesh
+	uint32_t indicesCount;	// au plus 3 * MESHLET_MAX_TRIANGLES
+	vec3 center;			// sphere englobante, en unites du modele
+	float radius;
+	vec3 coneAxis;			// cone des normales : axe unitaire (moyenne des normales des triangles)
+	float coneCutoff;		// sinus de l'ouverture du cone, >= 1 si le meshlet ne peut jamais etre elimine de dos
+};
+
+// decoupe l'index buffer en meshlets d'au plus maxVertices sommets distincts et maxTriangles triangles
+// un meshlet croit a partir du premier triangle restant (ordre d'entree) en ajoutant le triangle voisin
+// qui ajoute le moins de sommets puis dont la normale est la plus proche de celle du meshlet (cone etroit).
+// les triangles de indices sont reordonnes meshlet par meshlet, chaque meshlet est un intervalle contigu
+// et les meshlets visibles consecutifs d'une frame se regroupent en un seul intervalle
+void BuildMeshlets(std::vector<Meshlet>& meshlets, uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+	uint32_t maxVertices = MESHLET_MAX_VERTICES, uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// portion d'un mesh, avec ses propres sommets et indices locaux
+struct MeshPart
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// decoupe un mesh en parties d'au plus maxVertices sommets (65535 : indices 16 bits)
+// les triangles sont parcourus dans l'ordre, l'optimisation du cache de sommets est donc conservee
+void SplitMesh(std::vector<MeshPart>& parts, const Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+	uint32_t maxVertices = 65535);
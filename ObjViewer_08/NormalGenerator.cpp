@@ -0,0 +1,223 @@
+#include "NormalGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "mat4.h"		// M_PI (_USE_MATH_DEFINES)
+
+namespace
+{
+	struct Normal
+	{
+		float x, y, z;
+	};
+
+	static inline Normal Cross(const Normal& a, const Normal& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	static inline float Dot(const Normal& a, const Normal& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	static inline Normal Normalize(const Normal& n)
+	{
+		const float length = sqrtf(Dot(n, n));
+		if (length == 0.f)
+			return n;
+		return { n.x / length, n.y / length, n.z / length };
+	}
+
+	// approximation de acos (Abramowitz & Stegun 4.4.45), erreur < 7e-5 radian
+	// largement suffisant pour une ponderation et plusieurs fois plus rapide que acosf
+	static inline float FastAcos(float x)
+	{
+		const float a = fabsf(x);
+		const float r = sqrtf(1.f - a) * (1.5707288f + a * (-0.2121144f + a * (0.0742610f + a * -0.0187293f)));
+		return x < 0.f ? float(M_PI) - r : r;
+	}
+
+	// execute fn(begin, end) sur des intervalles contigus de [0, count[, un par thread
+	// les petits tableaux sont traites sur le thread appelant
+	template <typename Function>
+	void ParallelRanges(size_t count, uint32_t threadCount, const Function& fn)
+	{
+		const size_t minRangeSize = 16 * 1024;
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		const size_t rangeCount = std::max<size_t>(1, std::min<size_t>(threadCount, count / minRangeSize));
+		if (rangeCount == 1) {
+			fn(size_t(0), count);
+			return;
+		}
+		std::vector<std::thread> workers;
+		workers.reserve(rangeCount);
+		for (size_t i = 0; i < rangeCount; ++i)
+			workers.emplace_back([&fn, i, count, rangeCount]() { fn(count * i / rangeCount, count * (i + 1) / rangeCount); });
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+}
+
+size_t GenerateNormals(tinyobj::attrib_t& attrib, tinyobj::shape_t& shape, float creaseAngle, uint32_t threadCount)
+{
+	std::vector<tinyobj::index_t>& indices = shape.mesh.indices;
+	const size_t cornerCount = indices.size();
+	const size_t faceCount = cornerCount / 3;
+	const size_t positionCount = attrib.vertices.size() / 3;
+
+	// rien a faire si tous les coins ont deja une normale
+	bool missing = false;
+	for (size_t c = 0; c < cornerCount && !missing; c++)
+		missing = (indices[c].normal_index < 0);
+	if (!missing)
+		return 0;
+
+	// groupes de lissage, cf. NormalGenerator.h
+	const std::vector<unsigned int>& groups = shape.mesh.smoothing_group_ids;
+	bool hasGroups = false;
+	for (size_t f = 0; f < groups.size() && !hasGroups; f++)
+		hasGroups = (groups[f] != 0);
+	auto SmoothingGroup = [&](size_t face) -> unsigned int {
+		return hasGroups ? (face < groups.size() ? groups[face] : 0) : 1;
+	};
+
+	const bool useCrease = (creaseAngle < 180.f);
+	const float cosCrease = cosf(creaseAngle * float(M_PI / 180.0));
+
+	// 1. normale unitaire de chaque face et poids de chaque coin (angle x aire)
+	// la contribution d'un coin est faceNormals[face] * weights[coin], on evite ainsi de stocker un vecteur par coin
+	std::vector<Normal> faceNormals(faceCount);
+	std::vector<float> weights(cornerCount);
+	ParallelRanges(faceCount, threadCount, [&](size_t begin, size_t end)
+	{
+		for (size_t f = begin; f < end; f++)
+		{
+			Normal p[3];
+			for (int k = 0; k < 3; k++) {
+				const float* position = &attrib.vertices[3 * size_t(indices[3 * f + k].vertex_index)];
+				p[k] = { position[0], position[1], position[2] };
+			}
+			const Normal e[3] = {
+				{ p[1].x - p[0].x, p[1].y - p[0].y, p[1].z - p[0].z },
+				{ p[2].x - p[1].x, p[2].y - p[1].y, p[2].z - p[1].z },
+				{ p[0].x - p[2].x, p[0].y - p[2].y, p[0].z - p[2].z }
+			};
+			const Normal cross = Cross(e[0], { -e[2].x, -e[2].y, -e[2].z });
+			const float doubleArea = sqrtf(Dot(cross, cross));
+			const Normal n = Normalize(cross);
+			faceNormals[f] = n;
+
+			// angle au coin k entre les aretes sortantes e[k] et -e[k-1]
+			for (int k = 0; k < 3; k++)
+			{
+				const Normal& a = e[k];
+				const Normal& b = e[(k + 2) % 3];
+				const float lengths = sqrtf(Dot(a, a) * Dot(b, b));
+				const float cosAngle = lengths > 0.f ? std::min(1.f, std::max(-1.f, -Dot(a, b) / lengths)) : 1.f;
+				weights[3 * f + k] = FastAcos(cosAngle) * doubleArea;
+			}
+		}
+	});
+
+	// 2. coins regroupes par position (tri par denombrement, l'ordre des coins est conserve)
+	std::vector<uint32_t> firstCorner(positionCount + 1, 0);
+	for (size_t c = 0; c < cornerCount; c++)
+		firstCorner[indices[c].vertex_index + 1]++;
+	for (size_t v = 0; v < positionCount; v++)
+		firstCorner[v + 1] += firstCorner[v];
+	std::vector<uint32_t> corners(cornerCount);
+	{
+		std::vector<uint32_t> cursor(firstCorner.begin(), firstCorner.end() - 1);
+		for (size_t c = 0; c < cornerCount; c++)
+			corners[cursor[indices[c].vertex_index]++] = uint32_t(c);
+	}
+
+	// 3. normale de chaque coin sans 'vn', et premier coin de la meme position ayant exactement la meme normale
+	std::vector<Normal> cornerNormals(cornerCount);
+	std::vector<uint32_t> representative(cornerCount);
+	ParallelRanges(positionCount, threadCount, [&](size_t begin, size_t end)
+	{
+		for (size_t v = begin; v < end; v++)
+		{
+			const uint32_t* first = corners.data() + firstCorner[v];
+			const uint32_t* last = corners.data() + firstCorner[v + 1];
+			for (const uint32_t* it = first; it != last; ++it)
+			{
+				const uint32_t c = *it;
+				if (indices[c].normal_index >= 0)
+					continue;
+				const size_t face = c / 3;
+				const unsigned int group = SmoothingGroup(face);
+
+				// sans angle de pli tous les coins d'un meme groupe ont la meme normale, on reprend celle du premier
+				const uint32_t* same = it;
+				if (!useCrease && group != 0) {
+					same = first;
+					while (same != it && (indices[*same].normal_index >= 0 || SmoothingGroup(*same / 3) != group))
+						++same;
+				}
+
+				Normal n = { 0.f, 0.f, 0.f };
+				if (group == 0)
+					n = faceNormals[face];
+				else if (same != it)
+					n = cornerNormals[*same];
+				else
+				{
+					for (const uint32_t* other = first; other != last; ++other)
+					{
+						const size_t otherFace = *other / 3;
+						if (SmoothingGroup(otherFace) != group)
+							continue;
+						if (useCrease && Dot(faceNormals[face], faceNormals[otherFace]) < cosCrease)
+							continue;
+						const float weight = weights[*other];
+						n.x += faceNormals[otherFace].x * weight;
+						n.y += faceNormals[otherFace].y * weight;
+						n.z += faceNormals[otherFace].z * weight;
+					}
+					n = Normalize(n);
+					// triangles degeneres (poids nuls)
+					if (n.x == 0.f && n.y == 0.f && n.z == 0.f)
+						n = faceNormals[face];
+				}
+				cornerNormals[c] = n;
+
+				representative[c] = c;
+				for (const uint32_t* other = first; other != it; ++other) {
+					const Normal& m = cornerNormals[*other];
+					if (indices[*other].normal_index < 0 && m.x == n.x && m.y == n.y && m.z == n.z) {
+						representative[c] = *other;
+						break;
+					}
+				}
+			}
+		}
+	});
+
+	// 4. ajout des normales distinctes a attrib.normals, dans l'ordre des coins
+	// le representant d'un coin le precede toujours, son indice est donc deja attribue
+	const size_t base = attrib.normals.size() / 3;
+	size_t generated = 0;
+	for (size_t c = 0; c < cornerCount; c++)
+	{
+		if (indices[c].normal_index >= 0)
+			continue;
+		if (representative[c] == c) {
+			const Normal& n = cornerNormals[c];
+			attrib.normals.push_back(n.x);
+			attrib.normals.push_back(n.y);
+			attrib.normals.push_back(n.z);
+			indices[c].normal_index = int(base + generated);
+			++generated;
+		}
+		else
+			indices[c].normal_index = indices[representative[c]].normal_index;
+	}
+	return generated;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "tiny_obj_loader.h"
+
+// Generation des normales d'une shape OBJ (faces sans 'vn')
+//
+// La normale d'un coin de triangle est la somme des normales des faces qui partagent sa position,
+// ponderees par l'angle au sommet et par l'aire de la face, en respectant :
+// - les groupes de lissage ('s') : seules les faces du meme groupe sont moyennees, 's off' (0) donne des facettes.
+//   Si la shape ne contient aucun groupe (aucune ligne 's'), toutes ses faces sont considerees lissees
+// - l'angle de pli (creaseAngle, en degres) : une face dont la normale s'ecarte de plus de creaseAngle
+//   de celle du coin n'y contribue pas (180 = desactive)
+//
+// Les normales produites sont dedoublonnees par position puis ajoutees a attrib.normals et les indices
+// normal_index (-1) des coins concernes sont mis a jour : la soudure des sommets (cf. Mesh::ParseObj)
+// fonctionne ensuite comme si le fichier contenait des 'vn'.
+// Les passes par face et par sommet sont reparties sur threadCount threads (0 = nombre de coeurs).
+// retourne le nombre de normales ajoutees
+size_t GenerateNormals(tinyobj::attrib_t& attrib, tinyobj::shape_t& shape, float creaseAngle = 180.f, uint32_t threadCount = 0);
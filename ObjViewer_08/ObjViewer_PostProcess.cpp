@@ -30,12 +30,62 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cfloat>
+#include <vector>
+#include <algorithm>
+#include <numeric>
 
 #include "../common/GLShader.h"
 #include "mat4.h"
 #include "Texture.h"
+#include "TextureStreamer.h"
 #include "Mesh.h"
 
+// points de liaison des uniform blocks, communs a tous les programmes
+static const uint32_t FRAME_BLOCK_BINDING = 0;
+static const uint32_t MATERIAL_BLOCK_BINDING = 1;
+
+// bloc FrameData des shaders (layout std140), ecrit une fois par frame et partage par opaqueShader et effectShader
+struct FrameData
+{
+	mat4 viewMatrix;
+	mat4 projectionMatrix;
+	vec3 cameraPosition;
+	float time;
+	float lightDirections[2][4];	// normalisees, vers les lumieres
+	float lightColors[2][4];
+};
+static_assert(sizeof(FrameData) == 208, "FrameData doit respecter la disposition std140 du bloc des shaders");
+
+// donnees propres a un SubMesh, lues par le vertex shader comme attributs d'instance (glVertexAttribDivisor)
+// en rendu indirect, baseInstance (= indice du SubMesh) designe l'element du SubMesh dessine
+struct DrawData
+{
+	vec3 positionOffset;	// a_PositionOffset
+	vec3 positionScale;		// a_PositionScale
+	float materialIndex;	// a_MaterialIndex, indice dans u_Materials
+};
+
+// commande de glMultiDrawElementsIndirect, disposition imposee par OpenGL
+struct DrawElementsIndirectCommand
+{
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;	// en indices (et non en octets) depuis le debut de l'IBO
+	int32_t baseVertex;
+	uint32_t baseInstance;
+};
+
+// transformation d'une instance (rendu instancie), lue par le vertex shader comme attributs d'instance a_InstanceRow0..2
+// les trois premieres lignes de la matrice (la derniere vaut toujours (0, 0, 0, 1)) : 48 octets au lieu de 64
+struct InstanceTransform
+{
+	float rows[3][4];
+};
+
 struct Framebuffer
 {
 	uint32_t FBO;
@@ -51,16 +101,14 @@ struct Framebuffer
 		width = (uint16_t)w;
 		height = (uint16_t)h;
 
-		// on bascule sur le sampler 0 (par defaut)
-		glActiveTexture(GL_TEXTURE0);
-		// creation de la texture servant de color buffer 
+		// creation de la texture servant de color buffer, sur le sampler 0 (par defaut)
 		glGenTextures(1, &colorBuffer);
-		glBindTexture(GL_TEXTURE_2D, colorBuffer);
+		GLState::BindTexture(0, GL_TEXTURE_2D, colorBuffer);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		if (useDepth) {
 			glGenTextures(1, &depthBuffer);
-			glBindTexture(GL_TEXTURE_2D, depthBuffer);
+			GLState::BindTexture(0, GL_TEXTURE_2D, depthBuffer);
 			// format interne (3eme param) indique le format de stockage en memoire video, combine usage et taille des donnes
 			// format (externe, 7eme et 8eme param) indique le format des donnees en RAM
 			// notez que si le format interne est different du format les pilotes OpenGL peuvent proceder a une conversion couteuse
@@ -73,10 +121,10 @@ struct Framebuffer
 
 		// Cette ligne n'est pas necessaire ici, mais il s'agit de montrer que le FBO ne necessite pas qu'une texture
 		// soit Bind pour etre utilisable comme attachment
-		glBindTexture(GL_TEXTURE_2D, 0);
+		GLState::BindTexture(0, GL_TEXTURE_2D, 0);
 
 		glGenFramebuffers(1, &FBO);
-		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		GLState::BindFramebuffer(FBO);
 		// On attache ensuite le lod 0 (dernier param) de la texture 'colorBuffer' (4eme param) qui est de type GL_TEXTURE_2D (3eme param)
 		// comme 'color attachment #0' (2eme param) de notre FBO precedemment bind comme GL_FRAMEBUFFER (1er param)
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorBuffer, 0);
@@ -94,11 +142,11 @@ struct Framebuffer
 	void DestroyFramebuffer()
 	{
 		if (depthBuffer)
-			glDeleteTextures(1, &depthBuffer);
+			GLState::DeleteTextures(1, &depthBuffer);
 		if (colorBuffer)
-			glDeleteTextures(1, &colorBuffer);
+			GLState::DeleteTextures(1, &colorBuffer);
 		if (FBO)
-			glDeleteFramebuffers(1, &FBO);
+			GLState::DeleteFramebuffer(FBO);
 		depthBuffer = 0;
 		colorBuffer = 0;
 		FBO = 0;
@@ -106,27 +154,268 @@ struct Framebuffer
 
 	void EnableRender()
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-		glViewport(0, 0, width, height);
+		GLState::BindFramebuffer(FBO);
+		GLState::Viewport(0, 0, width, height);
 	}
 
 	// force le rendu vers le backbuffer
 	static void RenderToBackBuffer(const uint32_t w = 0, const uint32_t h = 0)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLState::BindFramebuffer(0);
 		if (w != 0 && h != 0)
-			glViewport(0, 0, w, h);
+			GLState::Viewport(0, 0, w, h);
 	}
 };
 
+// compteurs d'appels OpenGL d'une frame
+struct RenderStats
+{
+	uint32_t drawCalls;
+	uint32_t materialChanges;	// changements de a_MaterialIndex (rendu non indirect)
+	uint32_t textureBinds;
+	uint32_t triangles;
+	uint32_t lodDraws[MAX_LOD_COUNT];	// nombre de draw calls par LOD
+	uint32_t meshlets;			// meshlets testes (SubMesh dessines au LOD 0)
+	uint32_t meshletsCulled;	// hors champ ou de dos
+	uint32_t trianglesCulled;
+	uint32_t stateChanges;		// appels transmis par GLState (frame entiere, envois de textures compris)
+	uint32_t redundantStates;	// appels filtres par GLState
+	uint32_t uniformUploads;	// glUniform* effectivement appeles (cf. GLShader::SetUniform)
+	uint32_t redundantUniforms;	// valeurs identiques a la precedente, non envoyees
+	uint32_t indirectCommands;	// commandes soumises par glMultiDrawElementsIndirect (0 sans rendu indirect)
+	uint32_t instances;			// instances dessinees par chaque draw call (1 sans rendu instancie)
+
+	RenderStats() : drawCalls(0), materialChanges(0), textureBinds(0), triangles(0), meshlets(0), meshletsCulled(0), trianglesCulled(0),
+		stateChanges(0), redundantStates(0), uniformUploads(0), redundantUniforms(0), indirectCommands(0), instances(1)
+	{
+		for (uint32_t lod = 0; lod < MAX_LOD_COUNT; lod++)
+			lodDraws[lod] = 0;
+	}
+};
+
+// LOD retenu pour un SubMesh lors de la derniere frame
+struct LodSelection
+{
+	uint32_t lod;
+	float projectedRadius;	// rayon de la sphere englobante a l'ecran, en pixels
+	float projectedError;	// erreur du LOD retenu a l'ecran, en pixels
+};
+
+static inline vec3 TransformPoint(const mat4& matrix, const vec3& p)
+{
+	const float* m = matrix.m;
+	return { m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+		m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+		m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14] };
+}
+
+static inline vec3 TransformVector(const mat4& matrix, const vec3& v)
+{
+	const float* m = matrix.m;
+	return { m[0] * v.x + m[4] * v.y + m[8] * v.z,
+		m[1] * v.x + m[5] * v.y + m[9] * v.z,
+		m[2] * v.x + m[6] * v.y + m[10] * v.z };
+}
+
+// elimination d'un meshlet par le CPU, en repere camera (camera a l'origine, regardant vers -z)
+// world et view ne doivent pas contenir de mise a l'echelle (distances et normales conservees)
+// - hors champ : la sphere englobante est entierement derriere l'un des plans du frustum
+// - de dos : le cone des normales garantit que tous les triangles sont vus de dos (Meshlet::coneCutoff)
+static bool IsMeshletVisible(const Meshlet& meshlet, const mat4& world, const mat4& view, const mat4& projection, float znear, float zfar)
+{
+	const vec3 center = TransformPoint(view, TransformPoint(world, meshlet.center));
+	const float radius = meshlet.radius;
+	if (center.z - radius > -znear || -center.z - radius > zfar)
+		return false;
+
+	// plans lateraux : |m[0] * x| <= -z et |m[5] * y| <= -z, distances normalisees
+	const float sx = projection.m[0], sy = projection.m[5];
+	const float limitX = radius * sqrtf(sx * sx + 1.f), limitY = radius * sqrtf(sy * sy + 1.f);
+	if (sx * center.x + center.z > limitX || -sx * center.x + center.z > limitX
+		|| sy * center.y + center.z > limitY || -sy * center.y + center.z > limitY)
+		return false;
+
+	if (meshlet.coneCutoff < 1.f)
+	{
+		const vec3 axis = TransformVector(view, TransformVector(world, meshlet.coneAxis));
+		const float distance = sqrtf(center.x * center.x + center.y * center.y + center.z * center.z);
+		if (center.x * axis.x + center.y * axis.y + center.z * axis.z >= meshlet.coneCutoff * distance + radius)
+			return false;
+	}
+	return true;
+}
+
+// choisit le LOD le plus simple dont l'erreur projetee reste sous maxPixelError
+// la distance est celle du point de la sphere englobante le plus proche de la camera
+// pixelScale : facteur de projection d'une longueur situee a une distance de 1, en pixels
+static LodSelection SelectLod(const SubMesh& mesh, const mat4& world, const mat4& view, float pixelScale, float znear, float maxPixelError)
+{
+	const vec3 center = TransformPoint(view, TransformPoint(world, mesh.center));
+	const float distance = std::max(sqrtf(center.x * center.x + center.y * center.y + center.z * center.z) - mesh.radius, znear);
+
+	LodSelection selection = { 0, mesh.radius * pixelScale / distance, 0.f };
+	for (uint32_t lod = mesh.lodCount - 1; lod > 0; lod--) {
+		const float projectedError = mesh.lods[lod].error * pixelScale / distance;
+		if (projectedError <= maxPixelError) {
+			selection.lod = lod;
+			selection.projectedError = projectedError;
+			break;
+		}
+	}
+	return selection;
+}
+
+// instances disposees sur une grille cubique centree a l'origine, espacees de spacing
+// chacune tourne d'un angle different autour de l'axe vertical, sans mise a l'echelle (cf. SelectLod)
+static std::vector<InstanceTransform> BuildInstanceGrid(uint32_t count, float spacing)
+{
+	uint32_t side = 1;
+	while (side * side * side < count)
+		side++;
+	const float origin = -0.5f * spacing * float(side - 1);
+
+	std::vector<InstanceTransform> instances(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const vec3 position = { origin + spacing * float(i % side), origin + spacing * float((i / side) % side), origin + spacing * float(i / (side * side)) };
+		// meme convention que mat4::rotationUp, l'angle d'or evite que les orientations voisines se repetent
+		const float angle = 2.399963f * float(i);
+		const float c = cosf(angle), s = sinf(angle);
+		const float rows[3][4] = { { c, 0.f, s, position.x }, { 0.f, 1.f, 0.f, position.y }, { -s, 0.f, c, position.z } };
+		memcpy(instances[i].rows, rows, sizeof(rows));
+	}
+	return instances;
+}
+
+// matrice monde complete d'une instance (world * instance), pour le choix du LOD par le CPU
+static mat4 InstanceWorldMatrix(const mat4& world, const InstanceTransform& instance)
+{
+	mat4 result;
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		for (uint32_t row = 0; row < 4; row++)
+		{
+			float sum = (column == 3) ? world.m[12 + row] : 0.f;
+			for (uint32_t k = 0; k < 3; k++)
+				sum += world.m[k * 4 + row] * instance.rows[k][column];
+			result.m[column * 4 + row] = sum;
+		}
+	}
+	return result;
+}
+
+// instance dont l'origine est la plus proche de la camera (en repere camera, camera a l'origine)
+static size_t NearestInstance(const std::vector<InstanceTransform>& instances, const mat4& world, const mat4& view)
+{
+	size_t nearest = 0;
+	float nearestDistance = FLT_MAX;
+	for (size_t i = 0; i < instances.size(); i++)
+	{
+		const vec3 origin = { instances[i].rows[0][3], instances[i].rows[1][3], instances[i].rows[2][3] };
+		const vec3 center = TransformPoint(view, TransformPoint(world, origin));
+		const float distance = center.x * center.x + center.y * center.y + center.z * center.z;
+		if (distance < nearestDistance) {
+			nearest = i;
+			nearestDistance = distance;
+		}
+	}
+	return nearest;
+}
+
+// simule la boucle de rendu de RenderOffscreen() pour un ordre donne des SubMesh
+// (utilise pour comparer l'ordre du fichier et l'ordre trie par materiau)
+static RenderStats CountStateChanges(const Mesh* object, const std::vector<uint32_t>& order)
+{
+	RenderStats stats;
+	int32_t currentMaterial = -2;
+	uint32_t currentTexture = UINT32_MAX;
+	for (uint32_t index : order)
+	{
+		const SubMesh& mesh = object->meshes[index];
+		if (mesh.materialId != currentMaterial) {
+			const Material& mat = mesh.materialId > -1 ? object->materials[mesh.materialId] : Material::defaultMaterial;
+			currentMaterial = mesh.materialId;
+			++stats.materialChanges;
+			if (mat.diffuseArray < 0 && mat.diffuseTexture != currentTexture) {
+				currentTexture = mat.diffuseTexture;
+				++stats.textureBinds;
+			}
+		}
+		++stats.drawCalls;
+	}
+	return stats;
+}
+
+// le rendu indirect dessine tous les SubMesh sans changement d'etat : les materiaux doivent tenir dans une seule plage
+// du bloc MaterialData et les textures non regroupees en tableaux se limiter a une seule, liee a l'unite 0 (sharedTexture,
+// UINT32_MAX s'il n'y en a aucune)
+static bool CanDrawIndirect(const Mesh* object, uint32_t* sharedTexture)
+{
+	*sharedTexture = UINT32_MAX;
+	if (object->materialCount + 1 > MATERIALS_PER_BLOCK)
+		return false;
+	for (uint32_t i = 0; i < object->meshCount; i++)
+	{
+		const int32_t materialId = object->meshes[i].materialId;
+		const Material& mat = materialId > -1 ? object->materials[materialId] : Material::defaultMaterial;
+		if (mat.diffuseArray >= 0)
+			continue;
+		if (*sharedTexture != UINT32_MAX && *sharedTexture != mat.diffuseTexture)
+			return false;
+		*sharedTexture = mat.diffuseTexture;
+	}
+	return true;
+}
+
 struct Application
 {
 	Mesh* object;
 	uint32_t quadVAO;
+	FrameData frameData;
+	uint32_t frameUBO;				// contenu de frameData, lie au point FRAME_BLOCK_BINDING
+
+	const char* sceneFile;			// fichier OBJ a afficher
+	std::vector<uint32_t> drawOrder;	// indices des SubMesh tries par materiau
+	RenderStats stats;				// compteurs de la derniere frame
+	std::vector<LodSelection> lodSelections;	// LOD de chaque SubMesh lors de la derniere frame
+	float lodPixelError;			// erreur tolere a l'ecran (en pixels) pour le choix du LOD
+	bool texturesPacked;			// textures regroupees en tableaux une fois entierement envoyees (cf. Mesh::PackTextures)
+	// intervalles d'indices des meshlets visibles d'un SubMesh (glMultiDrawElements), reutilises a chaque draw
+	std::vector<GLsizei> rangeCounts;
+	std::vector<void*> rangeOffsets;		// non const : signature de glMultiDrawElementsBaseVertex (GLEW)
+	std::vector<GLint> rangeBaseVertices;
+
+	// rendu indirect (GL_ARB_multi_draw_indirect) : une commande par SubMesh, ou par intervalle de meshlets visibles
+	bool indirectSupported;			// extensions presentes, DrawData attache au VAO
+	bool drawIndirect;				// textures et materiaux le permettent (cf. CanDrawIndirect)
+	uint32_t indirectTexture;		// seule texture non regroupee, UINT32_MAX s'il n'y en a pas
+	uint32_t indirectBuffer;		// GL_DRAW_INDIRECT_BUFFER, reecrit a chaque frame
+	std::vector<DrawElementsIndirectCommand> indirectCommands[2];	// indices 16 bits puis 32 bits
+	// attributs DrawData du shader opaque
+	struct DrawAttributes
+	{
+		int32_t positionOffset, positionScale, materialIndex;
+	} drawAttributes;
+
+	// rendu instancie : chaque SubMesh est dessine une seule fois pour toutes les instances (glDrawElementsInstancedBaseVertex)
+	uint32_t instanceCount;			// 1 sans rendu instancie, la transformation de l'instance est alors l'identite
+	std::vector<InstanceTransform> instanceTransforms;	// copie du VBO d'instances, pour le choix du LOD
+	int32_t instanceAttributes[3];	// a_InstanceRow0..2 du shader opaque
 
 	GLShader opaqueShader;
 	GLShader effectShader;			// shader post process
 
+	// locations des uniformes relevees une fois pour toutes apres Create(), plus de recherche par nom dans la boucle de rendu
+	struct OpaqueUniforms
+	{
+		int32_t worldMatrix;
+		int32_t diffuseArrays[MAX_TEXTURE_ARRAYS];
+	} opaqueUniforms;
+	struct EffectUniforms
+	{
+		int32_t texture;
+	} effectUniforms;
+
 	// dimensions du back buffer / Fenetre
 	int32_t width;
 	int32_t height;
@@ -148,6 +437,9 @@ struct Application
 		// on utilise un texture manager afin de ne pas recharger une texture deja en memoire
 		// de meme on va definir une ou plusieurs textures par defaut
 		Texture::SetupManager();
+		// les textures sont envoyees au GPU en arriere plan, 4 Mo par frame au plus (cf. Render)
+		// seule leur queue de mipmaps (32x32 et moins) est envoyee avant la premiere frame
+		TextureStreamer::Initialize();
 
 		opaqueShader.LoadVertexShader("opaque.vs.glsl");
 		opaqueShader.LoadFragmentShader("opaque.fs.glsl");
@@ -156,50 +448,196 @@ struct Application
 		effectShader.LoadFragmentShader("effet.fs.glsl");
 		effectShader.Create();
 
+		opaqueUniforms.worldMatrix = opaqueShader.GetUniformLocation("u_WorldMatrix");
+		// les tableaux de textures occupent les unites 1 a MAX_TEXTURE_ARRAYS, fixees une fois pour toutes
+		// tous les samplers sont affectes, meme ceux des tableaux inutilises : deux samplers de types differents
+		// (u_DiffuseTexture est sur l'unite 0) ne doivent jamais designer la meme unite (GL_INVALID_OPERATION au draw)
+		GLState::UseProgram(opaqueShader.GetProgram());
+		for (uint32_t i = 0; i < MAX_TEXTURE_ARRAYS; i++)
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "u_DiffuseArrays[%u]", i);
+			opaqueUniforms.diffuseArrays[i] = opaqueShader.GetUniformLocation(name);
+			opaqueShader.SetUniform(opaqueUniforms.diffuseArrays[i], int32_t(1 + i));
+		}
+		effectUniforms.texture = effectShader.GetUniformLocation("u_Texture");
+
+		// camera, temps et lumieres sont dans un uniform buffer partage : un changement de programme
+		// ne demande plus de renvoyer ces uniformes, et les materiaux sont dans un bloc indexe (cf. Mesh::UploadMaterials)
+		opaqueShader.BindUniformBlock("FrameData", FRAME_BLOCK_BINDING);
+		opaqueShader.BindUniformBlock("MaterialData", MATERIAL_BLOCK_BINDING);
+		effectShader.BindUniformBlock("FrameData", FRAME_BLOCK_BINDING);
+		// deux lumieres directionnelles fixes
+		const float invSqrt3 = 1.f / sqrtf(3.f);
+		const float lightDirections[2][4] = { { -invSqrt3, invSqrt3, invSqrt3, 0.f }, { invSqrt3, invSqrt3, invSqrt3, 0.f } };
+		const float lightColors[2][4] = { { 1.f, 1.f, 0.f, 0.f }, { 0.f, 1.f, 1.f, 0.f } };
+		memcpy(frameData.lightDirections, lightDirections, sizeof(lightDirections));
+		memcpy(frameData.lightColors, lightColors, sizeof(lightColors));
+		frameUBO = CreateBufferObject(BufferType::UBO, sizeof(FrameData), nullptr);
+		glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frameUBO);
+
 		object = new Mesh;
 
-		Mesh::ParseObj(object, "../data/lightning/lightning_obj.obj");
+		// le fichier est lu en parallele (cf. ParallelObjLoader), le resultat est identique a tinyobj::LoadObj
+		// puis conserve dans un cache binaire, les lancements suivants ne relisent plus l'OBJ (cf. MeshCache)
+		Mesh::ParseOptions options;
+		options.parallelLoad = true;
+		options.useCache = true;
+		// les index buffers sont reordonnes pour le cache de sommets du GPU (cf. MeshOptimizer)
+		options.optimizeVertexCache = true;
+		// puis les clusters de triangles exterieurs sont dessines en premier pour limiter l'overdraw
+		options.optimizeOverdraw = true;
+		// indices 16 bits des que possible, les SubMesh trop grands sont decoupes
+		options.shortIndices = true;
+		options.splitForShortIndices = true;
+		// sommets quantifies sur 20 octets au lieu de 36 (cf. PackedVertex)
+		options.vertexFormat = VERTEX_PACKED;
+		// normales lissees pour les fichiers qui n'en contiennent pas (scans), plis au-dela de 60 degres
+		options.generateNormals = true;
+		options.creaseAngle = 60.f;
+		// chaine de LOD (triangles divises par 2 a chaque niveau), choisie a chaque frame selon la taille a l'ecran
+		options.lodCount = MAX_LOD_COUNT;
+		// meshlets pour eliminer les groupes de triangles hors champ ou de dos
+		options.buildMeshlets = true;
+		// textures compressees BC1/BC3 (4 a 8 fois moins de memoire video), cuisinees au premier lancement
+		options.compressTextures = true;
+		// sans bloquer la boucle de rendu, les niveaux fins arrivent au fil des frames
+		options.streamTextures = true;
+		Mesh::ParseObj(object, sceneFile, options);
 
 		int32_t program = opaqueShader.GetProgram();
-		glUseProgram(program);
+		GLState::UseProgram(program);
 		// on connait deja les attributs que l'on doit assigner dans le shader
-		int32_t positionLocation = glGetAttribLocation(program, "a_Position");
-		int32_t normalLocation = glGetAttribLocation(program, "a_Normal");
-		int32_t texcoordsLocation = glGetAttribLocation(program, "a_TexCoords");
-		int32_t colorLocation = glGetAttribLocation(program, "a_Color");
-
-		for (uint32_t i = 0; i < object->meshCount; i++)
+		int32_t positionLocation = opaqueShader.GetAttributeLocation("a_Position");
+		int32_t normalLocation = opaqueShader.GetAttributeLocation("a_Normal");
+		int32_t texcoordsLocation = opaqueShader.GetAttributeLocation("a_TexCoords");
+		int32_t colorLocation = opaqueShader.GetAttributeLocation("a_Color");
+		drawAttributes.positionOffset = opaqueShader.GetAttributeLocation("a_PositionOffset");
+		drawAttributes.positionScale = opaqueShader.GetAttributeLocation("a_PositionScale");
+		drawAttributes.materialIndex = opaqueShader.GetAttributeLocation("a_MaterialIndex");
+		for (uint32_t r = 0; r < 3; r++)
 		{
-			SubMesh& mesh = object->meshes[i];
+			char name[32];
+			snprintf(name, sizeof(name), "a_InstanceRow%u", r);
+			instanceAttributes[r] = opaqueShader.GetAttributeLocation(name);
+		}
 
-			glGenVertexArrays(1, &mesh.VAO);
-			glBindVertexArray(mesh.VAO);
+		// tous les SubMesh partagent le meme VBO/IBO : un seul VAO pour tout l'objet
+		{
+			glGenVertexArrays(1, &object->VAO);
+			GLState::BindVertexArray(object->VAO);
 
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.IBO);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, object->IBO);
 
-			glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+			glBindBuffer(GL_ARRAY_BUFFER, object->VBO);
 			// Specifie la structure des donnees envoyees au GPU
-			glVertexAttribPointer(positionLocation, 3, GL_FLOAT, false, sizeof(Vertex), 0);
-			glVertexAttribPointer(normalLocation, 3, GL_FLOAT, false, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-			glVertexAttribPointer(texcoordsLocation, 2, GL_FLOAT, false, sizeof(Vertex), (void*)offsetof(Vertex, texcoords));
-			glVertexAttribPointer(colorLocation, 3, GL_UNSIGNED_BYTE, true, sizeof(Vertex), (void*)offsetof(Vertex, color));
+			if (object->vertexFormat == VERTEX_PACKED)
+			{
+				// la conversion vers des flottants est faite par le GPU lors de la lecture des attributs
+				// positions unorm16 (dans [0;1], cf. u_PositionOffset/u_PositionScale), normales snorm 10-10-10-2, uv en half float
+				glVertexAttribPointer(positionLocation, 3, GL_UNSIGNED_SHORT, true, sizeof(PackedVertex), 0);
+				glVertexAttribPointer(normalLocation, 4, GL_INT_2_10_10_10_REV, true, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+				glVertexAttribPointer(texcoordsLocation, 2, GL_HALF_FLOAT, false, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texcoords));
+				glVertexAttribPointer(colorLocation, 3, GL_UNSIGNED_BYTE, true, sizeof(PackedVertex), (void*)offsetof(PackedVertex, color));
+			}
+			else
+			{
+				glVertexAttribPointer(positionLocation, 3, GL_FLOAT, false, sizeof(Vertex), 0);
+				glVertexAttribPointer(normalLocation, 3, GL_FLOAT, false, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+				glVertexAttribPointer(texcoordsLocation, 2, GL_FLOAT, false, sizeof(Vertex), (void*)offsetof(Vertex, texcoords));
+				glVertexAttribPointer(colorLocation, 3, GL_UNSIGNED_BYTE, true, sizeof(Vertex), (void*)offsetof(Vertex, color));
+			}
 			// indique que les donnees sont sous forme de tableau
 			glEnableVertexAttribArray(positionLocation);
 			glEnableVertexAttribArray(normalLocation);
 			glEnableVertexAttribArray(texcoordsLocation);
 			glEnableVertexAttribArray(colorLocation);
 
+			// DrawData de chaque SubMesh, un element par instance : en rendu indirect baseInstance designe le SubMesh
+			// les tableaux ne sont actives qu'en rendu indirect (cf. EnableDrawDataArrays), les valeurs constantes
+			// fixees par glVertexAttrib* les remplacent sinon
+			indirectSupported = GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance && GLEW_VERSION_3_3;
+			drawIndirect = false;
+			indirectBuffer = 0;
+			uint32_t drawDataVBO = 0;
+			if (indirectSupported)
+			{
+				std::vector<DrawData> drawData(object->meshCount);
+				for (uint32_t i = 0; i < object->meshCount; i++)
+				{
+					const SubMesh& mesh = object->meshes[i];
+					drawData[i] = { mesh.positionOffset, mesh.positionScale, float(uint32_t(mesh.materialId + 1) % MATERIALS_PER_BLOCK) };
+				}
+				drawDataVBO = CreateBufferObject(BufferType::VBO, sizeof(DrawData) * drawData.size(), drawData.data());
+				glVertexAttribPointer(drawAttributes.positionOffset, 3, GL_FLOAT, false, sizeof(DrawData), (void*)offsetof(DrawData, positionOffset));
+				glVertexAttribPointer(drawAttributes.positionScale, 3, GL_FLOAT, false, sizeof(DrawData), (void*)offsetof(DrawData, positionScale));
+				glVertexAttribPointer(drawAttributes.materialIndex, 1, GL_FLOAT, false, sizeof(DrawData), (void*)offsetof(DrawData, materialIndex));
+				glVertexAttribDivisor(drawAttributes.positionOffset, 1);
+				glVertexAttribDivisor(drawAttributes.positionScale, 1);
+				glVertexAttribDivisor(drawAttributes.materialIndex, 1);
+				glGenBuffers(1, &indirectBuffer);
+			}
+
+			// transformations des instances, un element par instance (diviseur 1), toujours lues depuis le VBO
+			// sans rendu instancie les tableaux restent desactives (valeurs constantes, cf. RenderOffscreen)
+			uint32_t instanceVBO = 0;
+			if (instanceCount > 1 && !GLEW_VERSION_3_3) {
+				std::cout << "[Render] rendu instancie non supporte (glVertexAttribDivisor, OpenGL 3.3), une seule instance" << std::endl;
+				instanceCount = 1;
+			}
+			if (instanceCount > 1)
+			{
+				// les instances sont espacees du diametre de l'objet, elles ne se chevauchent pas
+				float objectRadius = 0.f;
+				for (uint32_t i = 0; i < object->meshCount; i++)
+				{
+					const SubMesh& mesh = object->meshes[i];
+					const float distance = sqrtf(mesh.center.x * mesh.center.x + mesh.center.y * mesh.center.y + mesh.center.z * mesh.center.z);
+					objectRadius = std::max(objectRadius, distance + mesh.radius);
+				}
+				instanceTransforms = BuildInstanceGrid(instanceCount, 2.f * objectRadius);
+				instanceVBO = CreateBufferObject(BufferType::VBO, sizeof(InstanceTransform) * instanceTransforms.size(), instanceTransforms.data());
+				for (uint32_t r = 0; r < 3; r++)
+				{
+					glVertexAttribPointer(instanceAttributes[r], 4, GL_FLOAT, false, sizeof(InstanceTransform), (void*)(sizeof(float) * 4 * r));
+					glVertexAttribDivisor(instanceAttributes[r], 1);
+					glEnableVertexAttribArray(instanceAttributes[r]);
+				}
+			}
+
 			// ATTENTION, les instructions suivantes ne detruisent pas immediatement les VBO/IBO
 			// Ceci parcequ'ils sont rfrencs par le VAO. Ils ne seront dtruit qu'au moment
 			// de la destruction du VAO
-			glBindVertexArray(0);
-			DeleteBufferObject(mesh.VBO);
-			DeleteBufferObject(mesh.IBO);
+			GLState::BindVertexArray(0);
+			DeleteBufferObject(object->VBO);
+			DeleteBufferObject(object->IBO);
+			if (drawDataVBO)
+				DeleteBufferObject(drawDataVBO);
+			if (instanceVBO)
+				DeleteBufferObject(instanceVBO);
 		}
 
+		// on trie les SubMesh par materiau afin de ne modifier les uniformes et la texture
+		// que lorsque le materiau change (le tri est stable, l'ordre du fichier est conserve pour un meme materiau)
+		lodSelections.resize(object->meshCount);
+		lodPixelError = 1.f;
+		texturesPacked = false;
+
+		drawOrder.resize(object->meshCount);
+		std::iota(drawOrder.begin(), drawOrder.end(), 0);
+		std::vector<uint32_t> fileOrder = drawOrder;
+		std::stable_sort(drawOrder.begin(), drawOrder.end(), [this](uint32_t a, uint32_t b) {
+			return object->meshes[a].materialId < object->meshes[b].materialId;
+		});
+		RenderStats unsorted = CountStateChanges(object, fileOrder);
+		RenderStats sorted = CountStateChanges(object, drawOrder);
+		std::cout << "[Render] " << sorted.drawCalls << " draw calls, changements de materiau : "
+			<< unsorted.materialChanges << " -> " << sorted.materialChanges << ", bind de texture : "
+			<< unsorted.textureBinds << " -> " << sorted.textureBinds << " (ordre du fichier -> tri par materiau)" << std::endl;
+
 
 		// force le framebuffer sRGB
-		glEnable(GL_FRAMEBUFFER_SRGB);
+		GLState::Enable(GL_FRAMEBUFFER_SRGB);
 
 		offscreenBuffer.CreateFramebuffer(width, height, true);
 		
@@ -208,25 +646,25 @@ struct Application
 
 			// VAO du carr plein ecran pour le shader de copie
 			glGenVertexArrays(1, &quadVAO);
-			glBindVertexArray(quadVAO);
+			GLState::BindVertexArray(quadVAO);
 			uint32_t vbo = CreateBufferObject(BufferType::VBO, sizeof(quad), quad);
 
 			program = effectShader.GetProgram();
-			glUseProgram(program);
-			int32_t positionLocation = glGetAttribLocation(program, "a_Position");
+			GLState::UseProgram(program);
+			int32_t positionLocation = effectShader.GetAttributeLocation("a_Position");
 			glVertexAttribPointer(positionLocation, 2, GL_FLOAT, false, sizeof(vec2), 0);
 			glEnableVertexAttribArray(positionLocation);
 
 			// maintenant que le VAO a enregistre le detail des attributs ainsi que la reference du VBO
 			// on peut supprimer ce dernier car il ne nous servira plus de maniere explicite
 			// attention a toujours desactiver les VAO avant d'agir sur un BO
-			glBindVertexArray(0);
+			GLState::BindVertexArray(0);
 			DeleteBufferObject(vbo);
 		}
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glUseProgram(0);
+		GLState::UseProgram(0);
 	}
 
 	// la scene est rendue hors ecran
@@ -238,93 +676,300 @@ struct Application
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		// Defini le viewport en pleine fenetre
-		glViewport(0, 0, width, height);
+		GLState::Viewport(0, 0, width, height);
 
 		// En 3D il est usuel d'activer le depth test pour trier les faces, et cacher les faces arrires
 		// Par dfaut OpenGL considre que les faces anti-horaires sont visibles (Counter Clockwise, CCW)
-		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_CULL_FACE);
+		// GLState ne transmet ces appels que si l'etat change (cf. Render)
+		GLState::Enable(GL_DEPTH_TEST);
+		GLState::Enable(GL_CULL_FACE);
 
-		uint32_t program = opaqueShader.GetProgram();
-		glUseProgram(program);
+		GLState::UseProgram(opaqueShader.GetProgram());
 
 		// calcul des matrices model (une simple rotation), view (une translation inverse) et projection
 		// ces matrices sont communes  tous les SubMesh
 		mat4 world, view, perspective;
-		world.rotationUp((float)glfwGetTime());
+		world.rotationUp(frameData.time);
 		vec3 position = { 0.f, 0.f, -100.f };
 		view.translation(position);
-		perspective.perspective(45.f, (float)width / (float)height, 0.1f, 1000.f);
-
-		int32_t worldLocation = glGetUniformLocation(program, "u_WorldMatrix");
-		glUniformMatrix4fv(worldLocation, 1, false, world.m);
-		int32_t viewLocation = glGetUniformLocation(program, "u_ViewMatrix");
-		glUniformMatrix4fv(viewLocation, 1, false, view.m);
-		int32_t projectionLocation = glGetUniformLocation(program, "u_ProjectionMatrix");
-		glUniformMatrix4fv(projectionLocation, 1, false, perspective.m);
-
-		// On va maintenant affecter les valeurs du matriau  chaque SubMesh
-		// On peut ventuellement optimiser cette boucle en triant les SubMesh par materialID
-		// On ne devra modifier les uniformes que lorsque le materialID change
-		int32_t ambientLocation = glGetUniformLocation(program, "u_Material.AmbientColor");
-		int32_t diffuseLocation = glGetUniformLocation(program, "u_Material.DiffuseColor");
-		int32_t specularLocation = glGetUniformLocation(program, "u_Material.SpecularColor");
-		int32_t shininessLocation = glGetUniformLocation(program, "u_Material.Shininess");
-
-		// position de la camera
-		int32_t camPosLocation = glGetUniformLocation(program, "u_CameraPosition");
-		glUniform3fv(camPosLocation, 1, &position.x);
+		const float znear = 0.1f, zfar = 1000.f;
+		perspective.perspective(45.f, (float)width / (float)height, znear, zfar);
+		// une longueur l a la distance d couvre l * m[5] / d en coordonnees normalisees, soit height / 2 pixels par unite
+		const float pixelScale = perspective.m[5] * 0.5f * (float)height;
+
+		// donnees de la frame (matrices view et projection, position de la camera, temps), un seul envoi pour tous les programmes
+		frameData.viewMatrix = view;
+		frameData.projectionMatrix = perspective;
+		frameData.cameraPosition = position;
+		glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frameData);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		// les uniformes identiques a la frame precedente ne sont pas renvoyes (cf. GLShader::SetUniform)
+		opaqueShader.ResetUniformStatistics();
+		opaqueShader.SetUniformMatrix4(opaqueUniforms.worldMatrix, world.m);
+
+		// dequantification des positions, propre a chaque SubMesh (identite pour VERTEX_FLOAT)
+		const bool packedVertices = (object->vertexFormat == VERTEX_PACKED);
+		if (!drawIndirect && !packedVertices) {
+			glVertexAttrib3f(drawAttributes.positionOffset, 0.f, 0.f, 0.f);
+			glVertexAttrib3f(drawAttributes.positionScale, 1.f, 1.f, 1.f);
+		}
+		if (instanceCount == 1) {
+			glVertexAttrib4f(instanceAttributes[0], 1.f, 0.f, 0.f, 0.f);
+			glVertexAttrib4f(instanceAttributes[1], 0.f, 1.f, 0.f, 0.f);
+			glVertexAttrib4f(instanceAttributes[2], 0.f, 0.f, 1.f, 0.f);
+		}
+		// toutes les instances d'un SubMesh partagent le meme LOD, celui de l'instance la plus proche de la camera :
+		// il n'est jamais plus grossier que necessaire. Les meshlets ne sont pas elimines, leur visibilite depend de l'instance
+		const bool instanced = (instanceCount > 1);
+		const mat4 lodWorld = instanced ? InstanceWorldMatrix(world, instanceTransforms[NearestInstance(instanceTransforms, world, view)]) : world;
+
+		// les tableaux de textures occupent les unites 1 a MAX_TEXTURE_ARRAYS (cf. Initialize), le materiau designe un tableau et une couche
+		for (uint32_t i = 0; i < object->textureArrayCount; i++)
+			GLState::BindTexture(1 + i, GL_TEXTURE_2D_ARRAY, object->textureArrays[i]);
+
+		// bind implicitement le VBO et l'IBO communs, ainsi que les definitions d'attributs
+		GLState::BindVertexArray(object->VAO);
+
+		stats = RenderStats();
+		stats.instances = instanceCount;
+		int32_t currentMaterial = -2;			// -1 designe le materiau par defaut
+		uint32_t currentTexture = UINT32_MAX;
+		uint32_t currentMaterialWindow = UINT32_MAX;
+		if (drawIndirect)
+		{
+			// aucun changement d'etat entre les SubMesh : une seule plage de materiaux, une seule texture hors tableaux
+			glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, object->materialUBO, 0, sizeof(MaterialBlock) * MATERIALS_PER_BLOCK);
+			if (indirectTexture != UINT32_MAX)
+				GLState::BindTexture(0, GL_TEXTURE_2D, indirectTexture);
+			indirectCommands[0].clear();
+			indirectCommands[1].clear();
+		}
+		for (uint32_t index : drawOrder)
+		{
+			SubMesh& mesh = object->meshes[index];
+			// les materiaux sont tous dans object->materialUBO, un SubMesh ne designe que l'indice du sien
+			// les SubMesh sont tries par materialID (cf. drawOrder)
+			// On ne modifie donc a_MaterialIndex que lorsque le materialID change
+			if (!drawIndirect && mesh.materialId != currentMaterial)
+			{
+				Material& mat = mesh.materialId > -1 ? object->materials[mesh.materialId] : Material::defaultMaterial;
+				// le materiau par defaut occupe l'element 0, au-dela de MATERIALS_PER_BLOCK materiaux la plage liee est decalee
+				const uint32_t slot = uint32_t(mesh.materialId + 1);
+				const uint32_t window = slot / MATERIALS_PER_BLOCK;
+				if (window != currentMaterialWindow)
+				{
+					const size_t windowSize = sizeof(MaterialBlock) * MATERIALS_PER_BLOCK;
+					glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, object->materialUBO, window * windowSize, windowSize);
+					currentMaterialWindow = window;
+				}
+				glVertexAttrib1f(drawAttributes.materialIndex, float(slot % MATERIALS_PER_BLOCK));
+				currentMaterial = mesh.materialId;
+				++stats.materialChanges;
+
+				// plusieurs materiaux peuvent partager la meme texture, les textures regroupees sont deja liees
+				// les textures non regroupees utilisent l'unite 0
+				if (mat.diffuseArray < 0 && mat.diffuseTexture != currentTexture)
+				{
+					GLState::BindTexture(0, GL_TEXTURE_2D, mat.diffuseTexture);
+					currentTexture = mat.diffuseTexture;
+					++stats.textureBinds;
+				}
+			}
+
+			if (!drawIndirect && packedVertices) {
+				glVertexAttrib3fv(drawAttributes.positionOffset, &mesh.positionOffset.x);
+				glVertexAttrib3fv(drawAttributes.positionScale, &mesh.positionScale.x);
+			}
+
+			// LOD selon la taille a l'ecran, les LOD sont a la suite dans l'intervalle du SubMesh (IBO du Mesh)
+			LodSelection& selection = lodSelections[index];
+			selection = SelectLod(mesh, lodWorld, view, pixelScale, znear, lodPixelError);
+			const SubMeshLod& lod = mesh.lods[selection.lod];
+
+			// au LOD 0 seuls les meshlets visibles sont dessines, les meshlets consecutifs forment un seul intervalle
+			const bool useMeshlets = (!instanced && selection.lod == 0 && mesh.meshletCount > 0);
+			const uint32_t indexSize = (mesh.indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+			if (useMeshlets)
+			{
+				rangeCounts.clear();
+				rangeOffsets.clear();
+				rangeBaseVertices.clear();
+				uint32_t rangeEnd = UINT32_MAX;
+				for (uint32_t m = 0; m < mesh.meshletCount; m++)
+				{
+					const Meshlet& meshlet = object->meshlets[mesh.firstMeshlet + m];
+					if (!IsMeshletVisible(meshlet, world, view, perspective, znear, zfar)) {
+						++stats.meshletsCulled;
+						stats.trianglesCulled += meshlet.indicesCount / 3;
+						continue;
+					}
+					if (meshlet.firstIndex == rangeEnd)
+						rangeCounts.back() += meshlet.indicesCount;
+					else {
+						rangeCounts.push_back(meshlet.indicesCount);
+						rangeOffsets.push_back((void*)(uintptr_t)(mesh.indexOffset + meshlet.firstIndex * indexSize));
+						rangeBaseVertices.push_back(GLint(mesh.baseVertex));
+					}
+					rangeEnd = meshlet.firstIndex + meshlet.indicesCount;
+					stats.triangles += meshlet.indicesCount / 3;
+				}
+				stats.meshlets += mesh.meshletCount;
+				// tout le SubMesh est invisible
+				if (rangeCounts.empty())
+					continue;
+			}
+
+			// une commande par intervalle, soumises ensemble apres la boucle (cf. SubmitIndirect)
+			// toutes les textures sont alors entierement envoyees, aucune requete au TextureStreamer
+			if (drawIndirect)
+			{
+				std::vector<DrawElementsIndirectCommand>& commands = indirectCommands[indexSize == sizeof(uint16_t) ? 0 : 1];
+				if (useMeshlets) {
+					for (size_t r = 0; r < rangeCounts.size(); r++)
+						commands.push_back({ uint32_t(rangeCounts[r]), 1, uint32_t(uintptr_t(rangeOffsets[r]) / indexSize), GLint(mesh.baseVertex), index });
+				}
+				else {
+					commands.push_back({ lod.indicesCount, 1, (mesh.indexOffset + lod.indexOffset) / indexSize, GLint(mesh.baseVertex), index });
+					stats.triangles += lod.indicesCount / 3;
+				}
+				++stats.lodDraws[selection.lod];
+				continue;
+			}
+
+			// les niveaux fins des textures les plus grandes a l'ecran sont envoyes en priorite
+			TextureStreamer::Request(currentTexture, 2.f * selection.projectedRadius);
+
+			// dessine les triangles, les indices du SubMesh sont decales de baseVertex
+			if (useMeshlets)
+				glMultiDrawElementsBaseVertex(GL_TRIANGLES, rangeCounts.data(), mesh.indexType, rangeOffsets.data(), GLsizei(rangeCounts.size()),
+					rangeBaseVertices.data());
+			else if (instanced) {
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.indicesCount, mesh.indexType, (void*)(uintptr_t)(mesh.indexOffset + lod.indexOffset),
+					GLsizei(instanceCount), GLint(mesh.baseVertex));
+				stats.triangles += lod.indicesCount / 3 * instanceCount;
+			}
+			else {
+				glDrawElementsBaseVertex(GL_TRIANGLES, lod.indicesCount, mesh.indexType, (void*)(uintptr_t)(mesh.indexOffset + lod.indexOffset),
+					GLint(mesh.baseVertex));
+				stats.triangles += lod.indicesCount / 3;
+			}
+			++stats.drawCalls;
+			++stats.lodDraws[selection.lod];
+		}
+		if (drawIndirect)
+			SubmitIndirect();
+		stats.uniformUploads = opaqueShader.GetUniformUploads();
+		stats.redundantUniforms = opaqueShader.GetRedundantUniforms();
+	}
 
-		for (uint32_t i = 0; i < object->meshCount; i++)
+	// envoie les commandes de la frame puis les soumet, un glMultiDrawElementsIndirect par type d'indices
+	// le cout CPU ne depend plus du nombre de SubMesh (hors selection du LOD et elimination des meshlets)
+	void SubmitIndirect()
+	{
+		const std::vector<DrawElementsIndirectCommand>& shortCommands = indirectCommands[0];
+		const std::vector<DrawElementsIndirectCommand>& intCommands = indirectCommands[1];
+		const size_t shortBytes = sizeof(DrawElementsIndirectCommand) * shortCommands.size();
+		const size_t intBytes = sizeof(DrawElementsIndirectCommand) * intCommands.size();
+		stats.indirectCommands = uint32_t(shortCommands.size() + intCommands.size());
+		if (stats.indirectCommands == 0)
+			return;
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		// nouveau stockage a chaque frame, le driver n'attend pas que le GPU ait lu les commandes precedentes
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, shortBytes + intBytes, nullptr, GL_STREAM_DRAW);
+		if (shortBytes > 0) {
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, shortBytes, shortCommands.data());
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr, GLsizei(shortCommands.size()), 0);
+			++stats.drawCalls;
+		}
+		if (intBytes > 0) {
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, shortBytes, intBytes, intCommands.data());
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)shortBytes, GLsizei(intCommands.size()), 0);
+			++stats.drawCalls;
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	// attributs DrawData lus dans le VBO (rendu indirect) ou valeurs constantes (glVertexAttrib*), etat du VAO
+	void EnableDrawDataArrays(bool enable)
+	{
+		GLState::BindVertexArray(object->VAO);
+		const int32_t locations[] = { drawAttributes.positionOffset, drawAttributes.positionScale, drawAttributes.materialIndex };
+		for (int32_t location : locations)
 		{
-			SubMesh& mesh = object->meshes[i];
-			Material& mat = mesh.materialId > -1 ? object->materials[mesh.materialId] : Material::defaultMaterial;
-			glUniform3fv(ambientLocation, 1, &mat.ambientColor.x);
-			glUniform3fv(diffuseLocation, 1, &mat.diffuseColor.x);
-			glUniform3fv(specularLocation, 1, &mat.specularColor.x);
-			glUniform1f(shininessLocation, mat.shininess);
-
-			// glActiveTexture() n'est pas strictement requis ici car nous n'avons qu'une texture  la fois
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, mat.diffuseTexture);
-
-			// bind implicitement les VBO et IBO rattaches, ainsi que les definitions d'attributs
-			glBindVertexArray(mesh.VAO);
-			// dessine les triangles
-			glDrawElements(GL_TRIANGLES, object->meshes[i].indicesCount, GL_UNSIGNED_INT, 0);
+			if (enable)
+				glEnableVertexAttribArray(location);
+			else
+				glDisableVertexAttribArray(location);
 		}
 	}
 
 	void Render()
 	{
-		//glDisable(GL_FRAMEBUFFER_SRGB);
-		glEnable(GL_DEPTH_TEST);	// Active le test de profondeur (3D)
+		GLState::ResetStatistics();
+
+		// envois de textures de la frame, dans la limite du budget
+		TextureStreamer::Update();
+		// une fois toutes les textures entierement envoyees, elles sont regroupees : plus de glBindTexture par materiau
+		if (!texturesPacked && TextureStreamer::GetStatistics().pendingTextures == 0)
+		{
+			texturesPacked = true;
+			if (object->PackTextures()) {
+				RenderStats packed = CountStateChanges(object, drawOrder);
+				std::cout << "[Texture] " << object->textureArrayCount << " tableaux de textures, bind de texture par frame : "
+					<< packed.textureBinds << std::endl;
+			}
+			// sans changement d'etat entre les SubMesh, tout l'objet peut etre soumis en une fois
+			// baseInstance designe alors le SubMesh et decalerait aussi les transformations : pas en rendu instancie
+			drawIndirect = indirectSupported && instanceCount == 1 && CanDrawIndirect(object, &indirectTexture);
+			if (drawIndirect)
+				EnableDrawDataArrays(true);
+			std::cout << "[Render] rendu indirect (glMultiDrawElementsIndirect) : " << (drawIndirect ? "actif" :
+				!indirectSupported ? "non supporte" : instanceCount > 1 ? "desactive (rendu instancie)" : "impossible (materiaux ou textures)") << std::endl;
+		}
+
+		frameData.time = (float)glfwGetTime();
+
+		// GL_FRAMEBUFFER_SRGB reste actif pour les deux passes, GLState ne le renvoie plus a chaque frame
+		GLState::Enable(GL_DEPTH_TEST);	// Active le test de profondeur (3D)
 		RenderOffscreen();
 
-		glEnable(GL_FRAMEBUFFER_SRGB);
-		glDisable(GL_DEPTH_TEST);	// desactive le test de profondeur (2D)
+		GLState::Enable(GL_FRAMEBUFFER_SRGB);
+		GLState::Disable(GL_DEPTH_TEST);	// desactive le test de profondeur (2D)
 		// on va maintenant dessiner un quadrilatere plein ecran
 		// pour copier (sampler et inscrire dans le backbuffer) le color buffer du FBO
 		Framebuffer::RenderToBackBuffer(width, height);
 
-		uint32_t program = effectShader.GetProgram();
-		glUseProgram(program);
-
-		// notre effet post-process varie avec le temps
-		float time = (float)glfwGetTime();
-		int32_t timeLocation = glGetUniformLocation(program, "u_Time");
-		glUniform1f(timeLocation, time);
+		GLState::UseProgram(effectShader.GetProgram());
 
+		// notre effet post-process varie avec le temps (u_Time, envoye avec FrameData)
 		// on indique au shader que l'on va bind la texture sur le sampler 0 (TEXTURE0)
 		// pas necessaire techniquement car c'est le sampler par defaut
-		int32_t samplerLocation = glGetUniformLocation(program, "u_Texture");
-		glUniform1i(samplerLocation, 0);
+		effectShader.SetUniform(effectUniforms.texture, 0);
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, offscreenBuffer.colorBuffer);
+		GLState::BindTexture(0, GL_TEXTURE_2D, offscreenBuffer.colorBuffer);
 
-		glBindVertexArray(quadVAO);
+		GLState::BindVertexArray(quadVAO);
 		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+		stats.stateChanges = GLState::GetStatistics().forwardedCalls;
+		stats.redundantStates = GLState::GetStatistics().filteredCalls;
+	}
+
+	// detail des LOD choisis lors de la derniere frame (touche L)
+	void PrintLodSelections() const
+	{
+		std::cout << "[LOD] erreur toleree : " << lodPixelError << " pixel(s)" << std::endl;
+		for (uint32_t i = 0; i < object->meshCount; i++)
+		{
+			const SubMesh& mesh = object->meshes[i];
+			const LodSelection& selection = lodSelections[i];
+			std::cout << "[LOD] SubMesh " << i << " : LOD " << selection.lod << "/" << mesh.lodCount - 1
+				<< ", " << mesh.lods[selection.lod].indicesCount / 3 << " triangles (LOD 0 : " << mesh.indicesCount / 3
+				<< "), rayon " << selection.projectedRadius << " px, erreur " << selection.projectedError << " px" << std::endl;
+		}
 	}
 
 	void Resize(int w, int h)
@@ -341,13 +986,17 @@ struct Application
 
 	void Shutdown()
 	{
-		glDeleteVertexArrays(1, &quadVAO);
+		GLState::DeleteVertexArray(quadVAO);
 		quadVAO = 0;
+		if (indirectBuffer)
+			DeleteBufferObject(indirectBuffer);
+		DeleteBufferObject(frameUBO);
 		
 		object->Destroy();
 		delete object;
 
 		// On n'oublie pas de dtruire les objets OpenGL
+		TextureStreamer::Shutdown();
 
 		Texture::PurgeTextures();
 		
@@ -367,6 +1016,20 @@ void MouseCallback(GLFWwindow* , int, int, int) {
 
 }
 
+// L : affiche les LOD choisis, + / - : double ou divise par deux l'erreur toleree a l'ecran
+void KeyCallback(GLFWwindow* window, int key, int, int action, int)
+{
+	if (action != GLFW_PRESS)
+		return;
+	Application* app = (Application *)glfwGetWindowUserPointer(window);
+	if (key == GLFW_KEY_L)
+		app->PrintLodSelections();
+	else if (key == GLFW_KEY_KP_ADD || key == GLFW_KEY_EQUAL)
+		app->lodPixelError *= 2.f;
+	else if (key == GLFW_KEY_KP_SUBTRACT || key == GLFW_KEY_MINUS)
+		app->lodPixelError *= 0.5f;
+}
+
 
 int main(int argc, const char* argv[])
 {
@@ -385,6 +1048,10 @@ int main(int argc, const char* argv[])
 	}
 
 	Application app;
+	// le fichier OBJ peut etre passe en ligne de commande
+	app.sceneFile = argc > 1 ? argv[1] : "../data/lightning/lightning_obj.obj";
+	// suivi eventuellement du nombre d'instances (rendu instancie, ex: suzanne.obj 10000)
+	app.instanceCount = argc > 2 ? uint32_t(std::max(1, atoi(argv[2]))) : 1;
 
 	/* Make the window's context current */
 	glfwMakeContextCurrent(window);
@@ -394,6 +1061,7 @@ int main(int argc, const char* argv[])
 
 	// inputs
 	glfwSetMouseButtonCallback(window, MouseCallback);
+	glfwSetKeyCallback(window, KeyCallback);
 
 	// recuperation de la taille de la fenetre
 	glfwGetWindowSize(window, &app.width, &app.height);
@@ -405,6 +1073,8 @@ int main(int argc, const char* argv[])
 	// toutes nos initialisations vont ici
 	app.Initialize();
 
+	double lastTitleUpdate = 0.0;
+
 	/* Loop until the user closes the window */
 	while (!glfwWindowShouldClose(window))
 	{
@@ -413,6 +1083,21 @@ int main(int argc, const char* argv[])
 
 		app.Render();
 
+		// affichage des compteurs dans la barre de titre (une fois par seconde)
+		double now = glfwGetTime();
+		if (now - lastTitleUpdate > 1.0)
+		{
+			char title[1024];
+			const uint32_t* lods = app.stats.lodDraws;
+			snprintf(title, sizeof(title), "OBJ Viewer Multiple Shapes (%s) - %u draw calls, %u materiaux, %u textures, %u triangles, LOD %u/%u/%u/%u (%.2g px), meshlets elimines %u/%u (%u triangles), textures en attente %u, uniformes %u (%u redondants), etats GL %u (%u filtres), commandes indirectes %u, instances %u",
+				app.sceneFile, app.stats.drawCalls, app.stats.materialChanges, app.stats.textureBinds, app.stats.triangles,
+				lods[0], lods[1], lods[2], lods[3], app.lodPixelError, app.stats.meshletsCulled, app.stats.meshlets, app.stats.trianglesCulled,
+				TextureStreamer::GetStatistics().pendingTextures, app.stats.uniformUploads, app.stats.redundantUniforms,
+				app.stats.stateChanges, app.stats.redundantStates, app.stats.indirectCommands, app.stats.instances);
+			glfwSetWindowTitle(window, title);
+			lastTitleUpdate = now;
+		}
+
 		/* Swap front and back buffers */
 		glfwSwapBuffers(window);
 
@@ -1,23 +1,30 @@
 
 #include "OpenGLcore.h"
 
+#include <cstring>
+
 uint32_t CreateBufferObject(BufferType type, const size_t size, const void* data)
 {
 	uint32_t BO;
 	glGenBuffers(1, &BO);
 	GLenum target;
+	GLenum usage = GL_STATIC_DRAW;
 	switch (type) 
 	{
 	case BufferType::IBO:
 		target = GL_ELEMENT_ARRAY_BUFFER;
 		break;
+	case BufferType::UBO:
+		target = GL_UNIFORM_BUFFER;
+		usage = GL_DYNAMIC_DRAW;
+		break;
 	default:
 	case BufferType::VBO: 
 		target = GL_ARRAY_BUFFER; 
 		break;
 	}
 	glBindBuffer(target, BO);
-	glBufferData(target, size, data, GL_STATIC_DRAW);
+	glBufferData(target, size, data, usage);
 	return BO;
 }
 
@@ -26,24 +33,300 @@ void DeleteBufferObject(uint32_t& BO) {
 	BO = 0;
 }
 
-// notez que le format de donnee interne (GL_RGBA8) et image (GL_RGBA + GL_UNSIGNED_BYTE)
-// sont predefinis. Idem pour le filtrage. A vous de generaliser cette fonction.
-// Pensez egalement aux formats internes SRGB qui effectuent automatiquement la decompression du gamma
-uint32_t CreateTextureRGBA(const uint32_t width, const uint32_t height, const void* data, bool enableMipmaps)
+// format et type des pixels transmis a OpenGL pour chaque format interne
+struct PixelFormat
 {
-	uint32_t textureID;
+	uint32_t internalFormat;
+	uint32_t format;
+	uint32_t type;
+	uint32_t pixelSize;		// en octets, 0 pour un format compresse
+	uint32_t blockSize;		// en octets par bloc de 4x4 pixels, 0 pour un format non compresse
+};
+
+static const PixelFormat pixelFormats[] =
+{
+	{ GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, 0 },
+	{ GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, 0 },
+	{ GL_RG8, GL_RG, GL_UNSIGNED_BYTE, 2, 0 },
+	{ GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1, 0 },
+	{ GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8, 0 },
+	{ GL_RG16F, GL_RG, GL_HALF_FLOAT, 4, 0 },
+	{ GL_R16F, GL_RED, GL_HALF_FLOAT, 2, 0 },
+	{ GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 0, 0, 0, 8 },
+	{ GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 0, 0, 0, 8 },
+	{ GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0, 0, 0, 16 },
+	{ GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 0, 0, 0, 16 },
+};
+
+// un format inconnu est traite comme GL_RGBA8
+static const PixelFormat& FindPixelFormat(uint32_t internalFormat)
+{
+	for (const PixelFormat& format : pixelFormats)
+		if (format.internalFormat == internalFormat)
+			return format;
+	return pixelFormats[0];
+}
+
+uint32_t TextureLevelSize(uint32_t internalFormat, uint32_t width, uint32_t height)
+{
+	const PixelFormat& format = FindPixelFormat(internalFormat);
+	if (format.blockSize > 0)
+		return ((width + 3) / 4) * ((height + 3) / 4) * format.blockSize;
+	return width * height * format.pixelSize;
+}
+
+bool IsCompressedFormat(uint32_t internalFormat)
+{
+	return FindPixelFormat(internalFormat).blockSize > 0;
+}
+
+uint32_t CreateTexture(const TextureDesc& desc, const void* const* levels)
+{
+	const PixelFormat& format = FindPixelFormat(desc.internalFormat);
+	const bool array = (desc.target == GL_TEXTURE_2D_ARRAY);
+	uint32_t levelCount = desc.levelCount;
+	if (levelCount == 0)
+		while (((desc.width | desc.height) >> levelCount) != 0)
+			levelCount++;
 
+	uint32_t textureID;
 	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	if (enableMipmaps) {
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else {
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	GLState::BindTexture(0, desc.target, textureID);
 
+	const bool immutable = GLEW_ARB_texture_storage != 0;
+	if (immutable) {
+		if (array)
+			glTexStorage3D(desc.target, levelCount, desc.internalFormat, desc.width, desc.height, desc.layerCount);
+		else
+			glTexStorage2D(desc.target, levelCount, desc.internalFormat, desc.width, desc.height);
 	}
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		const uint32_t w = desc.width >> level ? desc.width >> level : 1;
+		const uint32_t h = desc.height >> level ? desc.height >> level : 1;
+		const void* data = levels ? levels[level] : nullptr;
+		// en stockage immuable seuls les niveaux fournis sont transmis
+		if (immutable && data == nullptr)
+			continue;
+		const uint32_t size = TextureLevelSize(desc.internalFormat, w, h) * desc.layerCount;
+		if (array) {
+			if (immutable && format.blockSize > 0)
+				glCompressedTexSubImage3D(desc.target, level, 0, 0, 0, w, h, desc.layerCount, desc.internalFormat, size, data);
+			else if (immutable)
+				glTexSubImage3D(desc.target, level, 0, 0, 0, w, h, desc.layerCount, format.format, format.type, data);
+			else if (format.blockSize > 0)
+				glCompressedTexImage3D(desc.target, level, desc.internalFormat, w, h, desc.layerCount, 0, size, data);
+			else
+				glTexImage3D(desc.target, level, desc.internalFormat, w, h, desc.layerCount, 0, format.format, format.type, data);
+		}
+		else {
+			if (immutable && format.blockSize > 0)
+				glCompressedTexSubImage2D(desc.target, level, 0, 0, w, h, desc.internalFormat, size, data);
+			else if (immutable)
+				glTexSubImage2D(desc.target, level, 0, 0, w, h, format.format, format.type, data);
+			else if (format.blockSize > 0)
+				glCompressedTexImage2D(desc.target, level, desc.internalFormat, w, h, 0, size, data);
+			else
+				glTexImage2D(desc.target, level, desc.internalFormat, w, h, 0, format.format, format.type, data);
+		}
+	}
+
+	// les niveaux absents ne doivent pas rendre la texture incomplete (stockage modifiable)
+	glTexParameteri(desc.target, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	glTexParameteri(desc.target, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+	uint32_t minFilter = desc.minFilter;
+	if (levelCount == 1 && minFilter != GL_NEAREST)
+		minFilter = GL_LINEAR;
+	glTexParameteri(desc.target, GL_TEXTURE_MIN_FILTER, minFilter);
+	glTexParameteri(desc.target, GL_TEXTURE_WRAP_S, desc.wrap);
+	glTexParameteri(desc.target, GL_TEXTURE_WRAP_T, desc.wrap);
+	if (desc.maxAnisotropy > 1.f && GLEW_EXT_texture_filter_anisotropic)
+		glTexParameterf(desc.target, GL_TEXTURE_MAX_ANISOTROPY_EXT, desc.maxAnisotropy);
 	return textureID;
-}
\ No newline at end of file
+}
+
+uint32_t CreateTextureRGBA(const uint32_t width, const uint32_t height, const void* data, bool enableMipmaps)
+{
+	if (!enableMipmaps)
+		return CreateTexture(TextureDesc(width, height, GL_RGBA8, 1), &data);
+
+	// les niveaux suivants sont calcules par le driver, le stockage doit donc les prevoir
+	const void* levels[32] = { data };
+	uint32_t textureID = CreateTexture(TextureDesc(width, height, GL_RGBA8, 0), levels);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	return textureID;
+}
+
+namespace GLState
+{
+	// valeur d'une liaison inconnue (contexte neuf ou Invalidate), differente de tout identifiant
+	static const uint32_t UNKNOWN = UINT32_MAX;
+
+	// cibles de texture suivies, dans l'ordre des colonnes de State::textures
+	static const uint32_t textureTargets[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY };
+	static const uint32_t TEXTURE_TARGET_COUNT = sizeof(textureTargets) / sizeof(textureTargets[0]);
+	static const uint32_t capabilities[] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_FRAMEBUFFER_SRGB };
+
+	struct State
+	{
+		uint32_t program;
+		uint32_t vertexArray;
+		uint32_t activeUnit;
+		uint32_t textures[MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+		uint32_t framebuffer;
+		int32_t viewport[4];
+		bool viewportKnown;
+		uint32_t knownCapabilities;		// un bit par element de capabilities
+		uint32_t enabledCapabilities;
+
+		State() { Reset(); }
+
+		void Reset()
+		{
+			program = vertexArray = activeUnit = framebuffer = UNKNOWN;
+			for (uint32_t unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+				for (uint32_t target = 0; target < TEXTURE_TARGET_COUNT; target++)
+					textures[unit][target] = UNKNOWN;
+			viewportKnown = false;
+			knownCapabilities = enabledCapabilities = 0;
+		}
+	};
+
+	static State state;
+	static Statistics statistics = { 0, 0 };
+
+	// vrai si value differe de current, qui est alors mis a jour ; compte l'appel transmis ou filtre
+	static bool Change(uint32_t& current, uint32_t value)
+	{
+		if (current == value) {
+			++statistics.filteredCalls;
+			return false;
+		}
+		current = value;
+		++statistics.forwardedCalls;
+		return true;
+	}
+
+	static int32_t FindIndex(const uint32_t* values, uint32_t count, uint32_t value)
+	{
+		for (uint32_t i = 0; i < count; i++)
+			if (values[i] == value)
+				return int32_t(i);
+		return -1;
+	}
+
+	void Invalidate()
+	{
+		state.Reset();
+	}
+
+	void UseProgram(uint32_t program)
+	{
+		if (Change(state.program, program))
+			glUseProgram(program);
+	}
+
+	void BindVertexArray(uint32_t vertexArray)
+	{
+		if (Change(state.vertexArray, vertexArray))
+			glBindVertexArray(vertexArray);
+	}
+
+	void BindTexture(uint32_t unit, uint32_t target, uint32_t texture)
+	{
+		if (Change(state.activeUnit, unit))
+			glActiveTexture(GL_TEXTURE0 + unit);
+		const int32_t column = FindIndex(textureTargets, TEXTURE_TARGET_COUNT, target);
+		if (unit >= MAX_TEXTURE_UNITS || column < 0) {
+			++statistics.forwardedCalls;
+			glBindTexture(target, texture);
+			return;
+		}
+		if (Change(state.textures[unit][column], texture))
+			glBindTexture(target, texture);
+	}
+
+	void BindFramebuffer(uint32_t framebuffer)
+	{
+		if (Change(state.framebuffer, framebuffer))
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	}
+
+	void Viewport(int32_t x, int32_t y, int32_t width, int32_t height)
+	{
+		const int32_t viewport[4] = { x, y, width, height };
+		if (state.viewportKnown && memcmp(state.viewport, viewport, sizeof(viewport)) == 0) {
+			++statistics.filteredCalls;
+			return;
+		}
+		memcpy(state.viewport, viewport, sizeof(viewport));
+		state.viewportKnown = true;
+		++statistics.forwardedCalls;
+		glViewport(x, y, width, height);
+	}
+
+	static void SetCapability(uint32_t capability, bool enable)
+	{
+		const int32_t index = FindIndex(capabilities, sizeof(capabilities) / sizeof(capabilities[0]), capability);
+		if (index >= 0)
+		{
+			const uint32_t bit = 1u << index;
+			if ((state.knownCapabilities & bit) && ((state.enabledCapabilities & bit) != 0) == enable) {
+				++statistics.filteredCalls;
+				return;
+			}
+			state.knownCapabilities |= bit;
+			state.enabledCapabilities = enable ? (state.enabledCapabilities | bit) : (state.enabledCapabilities & ~bit);
+		}
+		++statistics.forwardedCalls;
+		if (enable)
+			glEnable(capability);
+		else
+			glDisable(capability);
+	}
+
+	void Enable(uint32_t capability)
+	{
+		SetCapability(capability, true);
+	}
+
+	void Disable(uint32_t capability)
+	{
+		SetCapability(capability, false);
+	}
+
+	// glDelete* remet a 0 les liaisons de l'objet detruit
+	void DeleteTextures(uint32_t count, const uint32_t* textures)
+	{
+		for (uint32_t i = 0; i < count; i++)
+			for (uint32_t unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+				for (uint32_t target = 0; target < TEXTURE_TARGET_COUNT; target++)
+					if (state.textures[unit][target] == textures[i])
+						state.textures[unit][target] = 0;
+		glDeleteTextures(count, textures);
+	}
+
+	void DeleteFramebuffer(uint32_t framebuffer)
+	{
+		if (state.framebuffer == framebuffer)
+			state.framebuffer = 0;
+		glDeleteFramebuffers(1, &framebuffer);
+	}
+
+	void DeleteVertexArray(uint32_t vertexArray)
+	{
+		if (state.vertexArray == vertexArray)
+			state.vertexArray = 0;
+		glDeleteVertexArrays(1, &vertexArray);
+	}
+
+	const Statistics& GetStatistics()
+	{
+		return statistics;
+	}
+
+	void ResetStatistics()
+	{
+		statistics = { 0, 0 };
+	}
+}
@@ -10,6 +10,7 @@ enum BufferType
 {
 	VBO,
 	IBO,
+	UBO,	// uniform buffer (GL_DYNAMIC_DRAW), cf. glBindBufferBase/glBindBufferRange
 	MAX
 };
 
@@ -17,7 +18,77 @@ uint32_t CreateBufferObject(BufferType type, const size_t size, const void* data
 
 void DeleteBufferObject(uint32_t& BO);
 
-// notez que le format de donnee interne (GL_RGBA8) et image (GL_RGBA + GL_UNSIGNED_BYTE)
-// sont predefinis. Idem pour le filtrage qui est bilineaire. A vous de generaliser cette fonction.
-// Pensez egalement aux formats internes SRGB qui effectuent automatiquement la decompression du gamma
-uint32_t CreateTextureRGBA(const uint32_t width, const uint32_t height, const void* data, bool enableMipmaps = false);
\ No newline at end of file
+// description d'une texture pour CreateTexture
+// formats internes reconnus (le format et le type des pixels fournis en sont deduits) :
+// - GL_RGBA8, GL_SRGB8_ALPHA8, GL_RG8, GL_R8 : 8 bits par composante
+// - GL_RGBA16F, GL_RG16F, GL_R16F : half float (GL_HALF_FLOAT)
+// - GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT et leurs variantes SRGB : blocs de 4x4 pixels
+// les formats SRGB decodent le gamma lors de l'echantillonnage (avant le filtrage), les shaders recoivent du RGB lineaire
+struct TextureDesc
+{
+	uint32_t target;			// GL_TEXTURE_2D ou GL_TEXTURE_2D_ARRAY
+	uint32_t width;
+	uint32_t height;
+	uint32_t layerCount;		// nombre de couches d'un GL_TEXTURE_2D_ARRAY, 1 sinon
+	uint32_t levelCount;		// 0 : chaine de mipmaps complete (jusqu'a 1x1)
+	uint32_t internalFormat;
+	uint32_t minFilter;			// GL_LINEAR_MIPMAP_LINEAR est remplace par GL_LINEAR s'il n'y a qu'un niveau
+	uint32_t magFilter;
+	uint32_t wrap;				// GL_TEXTURE_WRAP_S et GL_TEXTURE_WRAP_T
+	float maxAnisotropy;		// > 1 : filtrage anisotrope (GL_EXT_texture_filter_anisotropic)
+
+	TextureDesc(uint32_t w = 1, uint32_t h = 1, uint32_t format = GL_RGBA8, uint32_t levels = 1) : target(GL_TEXTURE_2D)
+		, width(w), height(h), layerCount(1), levelCount(levels), internalFormat(format)
+		, minFilter(GL_LINEAR_MIPMAP_LINEAR), magFilter(GL_LINEAR), wrap(GL_REPEAT), maxAnisotropy(1.f) {}
+};
+
+// stockage immuable (glTexStorage2D/3D, OpenGL 4.2 ou GL_ARB_texture_storage) si disponible : tous les niveaux
+// sont alloues en une fois et le driver n'a plus a verifier la completude de la texture a chaque draw call.
+// levels[i] : pixels du niveau i (toutes les couches a la suite pour un tableau), nullptr = contenu indefini
+// levels peut etre nullptr (allocation seule), aucun glGenerateMipmap
+uint32_t CreateTexture(const TextureDesc& desc, const void* const* levels = nullptr);
+
+// taille en octets d'un niveau de width x height pixels (d'une couche)
+uint32_t TextureLevelSize(uint32_t internalFormat, uint32_t width, uint32_t height);
+bool IsCompressedFormat(uint32_t internalFormat);
+
+// texture RGBA8 d'un seul niveau, ou dont les mipmaps sont generes par le driver (enableMipmaps)
+uint32_t CreateTextureRGBA(const uint32_t width, const uint32_t height, const void* data, bool enableMipmaps = false);
+
+// Cache de l'etat OpenGL
+// programme, VAO, textures de chaque unite, framebuffer, viewport et capacites (glEnable) sont conserves cote CPU,
+// seuls les changements effectifs sont transmis au driver. Tout le code qui lie ces objets doit passer par GLState,
+// sinon l'etat connu est faux : appeler Invalidate() apres du code qui utilise directement gl*.
+// OpenGL delie un objet detruit et recycle son identifiant, la destruction passe donc aussi par GLState.
+namespace GLState
+{
+	static const uint32_t MAX_TEXTURE_UNITS = 16;
+
+	struct Statistics
+	{
+		uint32_t forwardedCalls;	// appels transmis au driver
+		uint32_t filteredCalls;		// appels ignores, l'etat etant deja celui demande
+	};
+
+	// l'etat du contexte est inconnu, les prochains appels sont tous transmis
+	void Invalidate();
+
+	void UseProgram(uint32_t program);
+	void BindVertexArray(uint32_t vertexArray);
+	// active unit (glActiveTexture) puis y lie texture : les glTexParameter/glTexSubImage suivants portent sur cette texture
+	// seules les cibles GL_TEXTURE_2D et GL_TEXTURE_2D_ARRAY sont suivies, les autres sont toujours transmises
+	void BindTexture(uint32_t unit, uint32_t target, uint32_t texture);
+	void BindFramebuffer(uint32_t framebuffer);
+	void Viewport(int32_t x, int32_t y, int32_t width, int32_t height);
+	// GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND et GL_FRAMEBUFFER_SRGB sont suivis, les autres capacites sont toujours transmises
+	void Enable(uint32_t capability);
+	void Disable(uint32_t capability);
+
+	void DeleteTextures(uint32_t count, const uint32_t* textures);
+	void DeleteFramebuffer(uint32_t framebuffer);
+	void DeleteVertexArray(uint32_t vertexArray);
+
+	// compteurs depuis le dernier ResetStatistics()
+	const Statistics& GetStatistics();
+	void ResetStatistics();
+}
\ No newline at end of file
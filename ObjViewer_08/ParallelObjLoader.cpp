@@ -0,0 +1,870 @@
+#include "ParallelObjLoader.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+	// indices d'un sommet de polygone, deja en base 0
+	// les indices relatifs (negatifs en OBJ) sont resolus localement puis decales par le nombre
+	// d'elements des blocs precedents (cf. relativeMask)
+	struct RawIndex
+	{
+		int v, vt, vn;
+		uint8_t relativeMask;
+	};
+
+	enum RelativeBits : uint8_t
+	{
+		RELATIVE_V = 1,
+		RELATIVE_VT = 2,
+		RELATIVE_VN = 4
+	};
+
+	enum CommandType : uint8_t
+	{
+		COMMAND_FACES,		// suite de polygones consecutifs
+		COMMAND_USEMTL,
+		COMMAND_MTLLIB,
+		COMMAND_GROUP,
+		COMMAND_OBJECT,
+		COMMAND_SMOOTHING
+	};
+
+	// les commandes sont rejouees dans l'ordre du fichier lors de la construction des shapes
+	struct Command
+	{
+		CommandType type;
+		size_t first;		// COMMAND_FACES : premier polygone, sinon debut de la ligne dans le fichier
+		size_t count;		// COMMAND_FACES : nombre de polygones, sinon longueur de la ligne
+	};
+
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<float> v, vc, vn, vt;
+		std::vector<RawIndex> polyIndices;
+		std::vector<uint32_t> polyStart;			// debut de chaque polygone dans polyIndices (+ sentinelle)
+		std::vector<Command> commands;
+		bool hasRelative;
+
+		// resultat de la triangulation
+		std::vector<tinyobj::index_t> triangles;
+		std::vector<uint32_t> triangleStart;		// premier triangle de chaque polygone (+ sentinelle)
+		int greatestV, greatestVn, greatestVt;
+
+		// decalages globaux (nombre de v, vn, vt des blocs precedents)
+		size_t offsetV, offsetVn, offsetVt;
+
+		std::string error;
+	};
+
+	// execute fn(i) pour i dans [0, count[ avec un thread par element
+	template <typename Function>
+	void ParallelFor(size_t count, const Function& fn)
+	{
+		if (count == 1) {
+			fn(size_t(0));
+			return;
+		}
+		std::vector<std::thread> workers;
+		workers.reserve(count);
+		for (size_t i = 0; i < count; ++i)
+			workers.emplace_back([&fn, i]() { fn(i); });
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	inline bool IsSpace(char c) { return c == ' ' || c == '\t'; }
+	inline bool IsDigit(char c) { return static_cast<unsigned int>(c - '0') < 10u; }
+
+	inline const char* SkipSpace(const char* p, const char* end)
+	{
+		while (p < end && IsSpace(*p))
+			++p;
+		return p;
+	}
+
+	inline const char* TokenEnd(const char* p, const char* end)
+	{
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+			++p;
+		return p;
+	}
+
+	// meme algorithme que tinyobj::tryParseDouble afin d'obtenir des valeurs identiques au bit pres
+	// (strtod() arrondit parfois differemment), seules les lectures au-dela de s_end sont protegees
+	bool TryParseDouble(const char* s, const char* s_end, double* result)
+	{
+		if (s >= s_end)
+			return false;
+
+		double mantissa = 0.0;
+		int exponent = 0;
+		char sign = '+';
+		char exp_sign = '+';
+		const char* curr = s;
+		int read = 0;
+
+		if (*curr == '+' || *curr == '-') {
+			sign = *curr;
+			curr++;
+		}
+		else if (!IsDigit(*curr)) {
+			return false;
+		}
+
+		while (curr != s_end && IsDigit(*curr)) {
+			mantissa *= 10;
+			mantissa += static_cast<int>(*curr - 0x30);
+			curr++;
+			read++;
+		}
+		if (read == 0)
+			return false;
+
+		if (curr != s_end) {
+			if (*curr == '.') {
+				curr++;
+				read = 1;
+				while (curr != s_end && IsDigit(*curr)) {
+					static const double pow_lut[] = { 1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001 };
+					const int lut_entries = sizeof pow_lut / sizeof pow_lut[0];
+					mantissa += static_cast<int>(*curr - 0x30) * (read < lut_entries ? pow_lut[read] : std::pow(10.0, -read));
+					read++;
+					curr++;
+				}
+			}
+
+			if (curr != s_end && (*curr == 'e' || *curr == 'E')) {
+				curr++;
+				if (curr != s_end && (*curr == '+' || *curr == '-')) {
+					exp_sign = *curr;
+					curr++;
+				}
+				else if (curr == s_end || !IsDigit(*curr)) {
+					return false;
+				}
+
+				read = 0;
+				while (curr != s_end && IsDigit(*curr)) {
+					exponent *= 10;
+					exponent += static_cast<int>(*curr - 0x30);
+					curr++;
+					read++;
+				}
+				exponent *= (exp_sign == '+' ? 1 : -1);
+				if (read == 0)
+					return false;
+			}
+		}
+
+		*result = (sign == '+' ? 1 : -1) * (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+		return true;
+	}
+
+	inline float ParseReal(const char** token, const char* end, double defaultValue = 0.0)
+	{
+		*token = SkipSpace(*token, end);
+		const char* tokenEnd = TokenEnd(*token, end);
+		double value = defaultValue;
+		TryParseDouble(*token, tokenEnd, &value);
+		*token = tokenEnd;
+		return static_cast<float>(value);
+	}
+
+	inline bool ParseReal(const char** token, const char* end, float* out)
+	{
+		*token = SkipSpace(*token, end);
+		const char* tokenEnd = TokenEnd(*token, end);
+		double value;
+		bool ok = TryParseDouble(*token, tokenEnd, &value);
+		if (ok)
+			*out = static_cast<float>(value);
+		*token = tokenEnd;
+		return ok;
+	}
+
+	// equivalent borne de atoi()
+	inline int ParseInt(const char* p, const char* end)
+	{
+		p = SkipSpace(p, end);
+		int sign = 1;
+		if (p < end && (*p == '+' || *p == '-')) {
+			sign = (*p == '-') ? -1 : 1;
+			++p;
+		}
+		int value = 0;
+		while (p < end && IsDigit(*p)) {
+			value = value * 10 + (*p - '0');
+			++p;
+		}
+		return sign * value;
+	}
+
+	// avance jusqu'au prochain '/', ' ', '\t' ou '\r' (strcspn de tinyobj)
+	inline const char* SkipIndex(const char* p, const char* end)
+	{
+		while (p < end && *p != '/' && *p != ' ' && *p != '\t' && *p != '\r')
+			++p;
+		return p;
+	}
+
+	// resolution d'un indice OBJ (base 1, negatif = relatif), cf. tinyobj::fixIndex
+	inline bool FixIndex(int index, size_t localCount, int* out, uint8_t* relativeMask, uint8_t bit)
+	{
+		if (index > 0) {
+			*out = index - 1;
+			return true;
+		}
+		if (index == 0)
+			return false;
+		*out = int(localCount) + index;
+		*relativeMask |= bit;
+		return true;
+	}
+
+	// i, i/j, i//k, i/j/k
+	bool ParseTriple(const char** token, const char* end, const Chunk& chunk, RawIndex* out)
+	{
+		RawIndex vi = { -1, -1, -1, 0 };
+		const char* p = *token;
+
+		if (!FixIndex(ParseInt(p, end), chunk.v.size() / 3, &vi.v, &vi.relativeMask, RELATIVE_V))
+			return false;
+		p = SkipIndex(p, end);
+		if (p < end && *p == '/') {
+			p++;
+			if (p < end && *p == '/') {
+				// i//k
+				p++;
+				if (!FixIndex(ParseInt(p, end), chunk.vn.size() / 3, &vi.vn, &vi.relativeMask, RELATIVE_VN))
+					return false;
+				p = SkipIndex(p, end);
+			}
+			else {
+				// i/j ou i/j/k
+				if (!FixIndex(ParseInt(p, end), chunk.vt.size() / 2, &vi.vt, &vi.relativeMask, RELATIVE_VT))
+					return false;
+				p = SkipIndex(p, end);
+				if (p < end && *p == '/') {
+					p++;
+					if (!FixIndex(ParseInt(p, end), chunk.vn.size() / 3, &vi.vn, &vi.relativeMask, RELATIVE_VN))
+						return false;
+					p = SkipIndex(p, end);
+				}
+			}
+		}
+		*token = p;
+		*out = vi;
+		return true;
+	}
+
+	void AddCommand(Chunk& chunk, CommandType type, const char* fileBegin, const char* line, const char* lineEnd)
+	{
+		chunk.commands.push_back({ type, size_t(line - fileBegin), size_t(lineEnd - line) });
+	}
+
+	// analyse d'un bloc de lignes, execute en parallele
+	void ParseChunk(Chunk& chunk, const char* fileBegin)
+	{
+		const size_t estimatedLines = size_t(chunk.end - chunk.begin) / 32;
+		chunk.v.reserve(estimatedLines);
+		chunk.vc.reserve(estimatedLines);
+		chunk.polyIndices.reserve(estimatedLines);
+		chunk.polyStart.reserve(estimatedLines / 2);
+		chunk.polyStart.push_back(0);
+		chunk.hasRelative = false;
+
+		const char* p = chunk.begin;
+		while (p < chunk.end)
+		{
+			// une ligne se termine par \n, \r\n ou \r (cf. safeGetline de tinyobj)
+			const char* lineEnd = p;
+			while (lineEnd < chunk.end && *lineEnd != '\n' && *lineEnd != '\r')
+				++lineEnd;
+			const char* next = lineEnd;
+			if (next < chunk.end) {
+				if (*next == '\r' && next + 1 < chunk.end && next[1] == '\n')
+					next += 2;
+				else
+					next += 1;
+			}
+
+			const char* token = SkipSpace(p, lineEnd);
+			p = next;
+
+			const size_t length = size_t(lineEnd - token);
+			if (length == 0 || token[0] == '#')
+				continue;
+
+			if (length >= 2 && token[0] == 'v' && IsSpace(token[1]))
+			{
+				token += 2;
+				float x = ParseReal(&token, lineEnd);
+				float y = ParseReal(&token, lineEnd);
+				float z = ParseReal(&token, lineEnd);
+				float r, g, b;
+				// extension : couleur par sommet, blanc par defaut comme tinyobj
+				if (!(ParseReal(&token, lineEnd, &r) && ParseReal(&token, lineEnd, &g) && ParseReal(&token, lineEnd, &b)))
+					r = g = b = 1.f;
+				chunk.v.push_back(x); chunk.v.push_back(y); chunk.v.push_back(z);
+				chunk.vc.push_back(r); chunk.vc.push_back(g); chunk.vc.push_back(b);
+				continue;
+			}
+
+			if (length >= 3 && token[0] == 'v' && token[1] == 'n' && IsSpace(token[2]))
+			{
+				token += 3;
+				float x = ParseReal(&token, lineEnd);
+				float y = ParseReal(&token, lineEnd);
+				float z = ParseReal(&token, lineEnd);
+				chunk.vn.push_back(x); chunk.vn.push_back(y); chunk.vn.push_back(z);
+				continue;
+			}
+
+			if (length >= 3 && token[0] == 'v' && token[1] == 't' && IsSpace(token[2]))
+			{
+				token += 3;
+				float x = ParseReal(&token, lineEnd);
+				float y = ParseReal(&token, lineEnd);
+				chunk.vt.push_back(x); chunk.vt.push_back(y);
+				continue;
+			}
+
+			if (length >= 2 && token[0] == 'f' && IsSpace(token[1]))
+			{
+				token = SkipSpace(token + 2, lineEnd);
+				while (token < lineEnd && *token != '\r' && *token != '\0')
+				{
+					RawIndex vi;
+					if (!ParseTriple(&token, lineEnd, chunk, &vi)) {
+						chunk.error = "Failed parse `f' line(e.g. zero value for face index.)\n";
+						return;
+					}
+					chunk.hasRelative |= (vi.relativeMask != 0);
+					chunk.polyIndices.push_back(vi);
+					while (token < lineEnd && (IsSpace(*token) || *token == '\r'))
+						++token;
+				}
+				// les polygones consecutifs sont regroupes dans une seule commande
+				const size_t polyIndex = chunk.polyStart.size() - 1;
+				chunk.polyStart.push_back(uint32_t(chunk.polyIndices.size()));
+				if (!chunk.commands.empty() && chunk.commands.back().type == COMMAND_FACES)
+					chunk.commands.back().count++;
+				else
+					chunk.commands.push_back({ COMMAND_FACES, polyIndex, 1 });
+				continue;
+			}
+
+			if (length >= 7 && strncmp(token, "usemtl", 6) == 0 && IsSpace(token[6])) {
+				AddCommand(chunk, COMMAND_USEMTL, fileBegin, token, lineEnd);
+				continue;
+			}
+			if (length >= 7 && strncmp(token, "mtllib", 6) == 0 && IsSpace(token[6])) {
+				AddCommand(chunk, COMMAND_MTLLIB, fileBegin, token, lineEnd);
+				continue;
+			}
+			if (length >= 2 && token[0] == 'g' && IsSpace(token[1])) {
+				AddCommand(chunk, COMMAND_GROUP, fileBegin, token, lineEnd);
+				continue;
+			}
+			if (length >= 2 && token[0] == 'o' && IsSpace(token[1])) {
+				AddCommand(chunk, COMMAND_OBJECT, fileBegin, token, lineEnd);
+				continue;
+			}
+			if (length >= 2 && token[0] == 's' && IsSpace(token[1])) {
+				AddCommand(chunk, COMMAND_SMOOTHING, fileBegin, token, lineEnd);
+				continue;
+			}
+			// les autres commandes (l, p, t...) sont ignorees
+		}
+	}
+
+	// code from https://wrf.ecse.rpi.edu//Research/Short_Notes/pnpoly.html (identique a tinyobj)
+	int PointInPolygon(int nvert, const float* vertx, const float* verty, float testx, float testy)
+	{
+		int i, j, c = 0;
+		for (i = 0, j = nvert - 1; i < nvert; j = i++) {
+			if (((verty[i] > testy) != (verty[j] > testy)) &&
+				(testx < (vertx[j] - vertx[i]) * (testy - verty[i]) / (verty[j] - verty[i]) + vertx[i]))
+				c = !c;
+		}
+		return c;
+	}
+
+	inline void EmitTriangle(std::vector<tinyobj::index_t>& out, const RawIndex& a, const RawIndex& b, const RawIndex& c)
+	{
+		out.push_back({ a.v, a.vn, a.vt });
+		out.push_back({ b.v, b.vn, b.vt });
+		out.push_back({ c.v, c.vn, c.vt });
+	}
+
+	// triangulation par "ear clipping", reprise telle quelle de tinyobj (exportGroupsToShape)
+	// afin de produire exactement les memes triangles
+	void TriangulatePolygon(const RawIndex* face, size_t npolys, const std::vector<float>& v,
+		std::vector<RawIndex>& remainingFace, std::vector<tinyobj::index_t>& out)
+	{
+		if (npolys < 3)
+			return;
+		if (npolys == 3) {
+			EmitTriangle(out, face[0], face[1], face[2]);
+			return;
+		}
+
+		// recherche des deux axes de projection
+		size_t axes[2] = { 1, 2 };
+		for (size_t k = 0; k < npolys; ++k) {
+			size_t vi0 = size_t(face[(k + 0) % npolys].v);
+			size_t vi1 = size_t(face[(k + 1) % npolys].v);
+			size_t vi2 = size_t(face[(k + 2) % npolys].v);
+			if (((3 * vi0 + 2) >= v.size()) || ((3 * vi1 + 2) >= v.size()) || ((3 * vi2 + 2) >= v.size()))
+				continue;
+			float e0x = v[vi1 * 3 + 0] - v[vi0 * 3 + 0];
+			float e0y = v[vi1 * 3 + 1] - v[vi0 * 3 + 1];
+			float e0z = v[vi1 * 3 + 2] - v[vi0 * 3 + 2];
+			float e1x = v[vi2 * 3 + 0] - v[vi1 * 3 + 0];
+			float e1y = v[vi2 * 3 + 1] - v[vi1 * 3 + 1];
+			float e1z = v[vi2 * 3 + 2] - v[vi1 * 3 + 2];
+			float cx = std::fabs(e0y * e1z - e0z * e1y);
+			float cy = std::fabs(e0z * e1x - e0x * e1z);
+			float cz = std::fabs(e0x * e1y - e0y * e1x);
+			const float epsilon = std::numeric_limits<float>::epsilon();
+			if (cx > epsilon || cy > epsilon || cz > epsilon) {
+				if (cx > cy && cx > cz) {
+				}
+				else {
+					axes[0] = 0;
+					if (cz > cx && cz > cy)
+						axes[1] = 1;
+				}
+				break;
+			}
+		}
+
+		float area = 0;
+		for (size_t k = 0; k < npolys; ++k) {
+			size_t vi0 = size_t(face[(k + 0) % npolys].v);
+			size_t vi1 = size_t(face[(k + 1) % npolys].v);
+			if (((vi0 * 3 + axes[0]) >= v.size()) || ((vi0 * 3 + axes[1]) >= v.size()) ||
+				((vi1 * 3 + axes[0]) >= v.size()) || ((vi1 * 3 + axes[1]) >= v.size()))
+				continue;
+			float v0x = v[vi0 * 3 + axes[0]];
+			float v0y = v[vi0 * 3 + axes[1]];
+			float v1x = v[vi1 * 3 + axes[0]];
+			float v1y = v[vi1 * 3 + axes[1]];
+			area += (v0x * v1y - v0y * v1x) * 0.5f;
+		}
+
+		remainingFace.assign(face, face + npolys);
+		size_t guess_vert = 0;
+		RawIndex ind[3];
+		float vx[3];
+		float vy[3];
+
+		size_t remainingIterations = npolys;
+		size_t previousRemainingVertices = remainingFace.size();
+
+		while (remainingFace.size() > 3 && remainingIterations > 0) {
+			npolys = remainingFace.size();
+			if (guess_vert >= npolys)
+				guess_vert -= npolys;
+
+			if (previousRemainingVertices != npolys) {
+				previousRemainingVertices = npolys;
+				remainingIterations = npolys;
+			}
+			else {
+				remainingIterations--;
+			}
+
+			for (size_t k = 0; k < 3; k++) {
+				ind[k] = remainingFace[(guess_vert + k) % npolys];
+				size_t vi = size_t(ind[k].v);
+				if (((vi * 3 + axes[0]) >= v.size()) || ((vi * 3 + axes[1]) >= v.size())) {
+					vx[k] = 0.f;
+					vy[k] = 0.f;
+				}
+				else {
+					vx[k] = v[vi * 3 + axes[0]];
+					vy[k] = v[vi * 3 + axes[1]];
+				}
+			}
+			float e0x = vx[1] - vx[0];
+			float e0y = vy[1] - vy[0];
+			float e1x = vx[2] - vx[1];
+			float e1y = vy[2] - vy[1];
+			float cross = e0x * e1y - e0y * e1x;
+			if (cross * area < 0.f) {
+				guess_vert += 1;
+				continue;
+			}
+
+			bool overlap = false;
+			for (size_t otherVert = 3; otherVert < npolys; ++otherVert) {
+				size_t idx = (guess_vert + otherVert) % npolys;
+				if (idx >= remainingFace.size())
+					continue;
+				size_t ovi = size_t(remainingFace[idx].v);
+				if (((ovi * 3 + axes[0]) >= v.size()) || ((ovi * 3 + axes[1]) >= v.size()))
+					continue;
+				float tx = v[ovi * 3 + axes[0]];
+				float ty = v[ovi * 3 + axes[1]];
+				if (PointInPolygon(3, vx, vy, tx, ty)) {
+					overlap = true;
+					break;
+				}
+			}
+			if (overlap) {
+				guess_vert += 1;
+				continue;
+			}
+
+			EmitTriangle(out, ind[0], ind[1], ind[2]);
+
+			size_t removed_vert_index = (guess_vert + 1) % npolys;
+			while (removed_vert_index + 1 < npolys) {
+				remainingFace[removed_vert_index] = remainingFace[removed_vert_index + 1];
+				removed_vert_index += 1;
+			}
+			remainingFace.pop_back();
+		}
+
+		if (remainingFace.size() == 3)
+			EmitTriangle(out, remainingFace[0], remainingFace[1], remainingFace[2]);
+	}
+
+	// resolution des indices relatifs puis triangulation, execute en parallele
+	void TriangulateChunk(Chunk& chunk, const std::vector<float>& v)
+	{
+		if (chunk.hasRelative) {
+			for (RawIndex& vi : chunk.polyIndices) {
+				if (vi.relativeMask & RELATIVE_V) vi.v += int(chunk.offsetV);
+				if (vi.relativeMask & RELATIVE_VT) vi.vt += int(chunk.offsetVt);
+				if (vi.relativeMask & RELATIVE_VN) vi.vn += int(chunk.offsetVn);
+			}
+		}
+
+		chunk.greatestV = chunk.greatestVn = chunk.greatestVt = -1;
+		for (const RawIndex& vi : chunk.polyIndices) {
+			chunk.greatestV = vi.v > chunk.greatestV ? vi.v : chunk.greatestV;
+			chunk.greatestVn = vi.vn > chunk.greatestVn ? vi.vn : chunk.greatestVn;
+			chunk.greatestVt = vi.vt > chunk.greatestVt ? vi.vt : chunk.greatestVt;
+		}
+
+		const size_t polyCount = chunk.polyStart.size() - 1;
+		chunk.triangles.reserve(chunk.polyIndices.size() * 2);
+		chunk.triangleStart.resize(polyCount + 1);
+		std::vector<RawIndex> remainingFace;
+		for (size_t i = 0; i < polyCount; ++i) {
+			chunk.triangleStart[i] = uint32_t(chunk.triangles.size() / 3);
+			TriangulatePolygon(&chunk.polyIndices[chunk.polyStart[i]], chunk.polyStart[i + 1] - chunk.polyStart[i], v, remainingFace, chunk.triangles);
+		}
+		chunk.triangleStart[polyCount] = uint32_t(chunk.triangles.size() / 3);
+	}
+
+	// polygones en attente d'etre ajoutes a la shape courante (equivalent de PrimGroup::faceGroup)
+	struct FaceRun
+	{
+		const Chunk* chunk;
+		size_t firstPoly;
+		size_t polyCount;
+		unsigned int smoothingId;
+	};
+
+	// equivalent de exportGroupsToShape()
+	bool ExportGroupsToShape(tinyobj::shape_t* shape, const std::vector<FaceRun>& faceGroup, int materialId, const std::string& name)
+	{
+		if (faceGroup.empty())
+			return false;
+
+		shape->name = name;
+		for (const FaceRun& run : faceGroup)
+		{
+			const Chunk& chunk = *run.chunk;
+			const size_t firstTriangle = chunk.triangleStart[run.firstPoly];
+			const size_t triangleCount = chunk.triangleStart[run.firstPoly + run.polyCount] - firstTriangle;
+			tinyobj::mesh_t& mesh = shape->mesh;
+			mesh.indices.insert(mesh.indices.end(), chunk.triangles.begin() + firstTriangle * 3, chunk.triangles.begin() + (firstTriangle + triangleCount) * 3);
+			mesh.num_face_vertices.insert(mesh.num_face_vertices.end(), triangleCount, (unsigned char)3);
+			mesh.material_ids.insert(mesh.material_ids.end(), triangleCount, materialId);
+			mesh.smoothing_group_ids.insert(mesh.smoothing_group_ids.end(), triangleCount, run.smoothingId);
+		}
+		return true;
+	}
+
+	void SplitString(const std::string& s, char delim, std::vector<std::string>& elems)
+	{
+		std::stringstream ss;
+		ss.str(s);
+		std::string item;
+		while (std::getline(ss, item, delim))
+			elems.push_back(item);
+	}
+}
+
+bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+	std::vector<tinyobj::material_t>* materials, std::string* warn, std::string* err,
+	const char* filename, const char* mtl_basedir, uint32_t threadCount)
+{
+	attrib->vertices.clear();
+	attrib->normals.clear();
+	attrib->texcoords.clear();
+	attrib->colors.clear();
+	shapes->clear();
+
+	MappedFile file;
+	if (!file.Open(filename)) {
+		if (err) {
+			std::stringstream ss;
+			ss << "Cannot open file [" << filename << "]" << std::endl;
+			(*err) = ss.str();
+		}
+		return false;
+	}
+
+	std::string baseDir = mtl_basedir ? mtl_basedir : "";
+	if (!baseDir.empty()) {
+#ifndef _WIN32
+		const char dirsep = '/';
+#else
+		const char dirsep = '\\';
+#endif
+		if (baseDir[baseDir.length() - 1] != dirsep)
+			baseDir += dirsep;
+	}
+	tinyobj::MaterialFileReader materialReader(baseDir);
+
+	// 1. decoupage en blocs, chaque bloc commence au debut d'une ligne
+	// on evite de creer des threads pour des blocs trop petits
+	const size_t minChunkSize = 256 * 1024;
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, file.size / minChunkSize));
+
+	const char* fileBegin = (const char*)file.data;
+	const char* fileEnd = fileBegin + file.size;
+	std::vector<Chunk> chunks(chunkCount);
+	const char* cursor = fileBegin;
+	for (size_t i = 0; i < chunkCount; ++i)
+	{
+		chunks[i].begin = cursor;
+		const char* split = (i == chunkCount - 1) ? fileEnd : fileBegin + (file.size / chunkCount) * (i + 1);
+		if (split < cursor)
+			split = cursor;
+		while (split < fileEnd && *split != '\n')
+			++split;
+		if (split < fileEnd)
+			++split;
+		chunks[i].end = split;
+		cursor = split;
+	}
+
+	// 2. analyse des lignes en parallele
+	ParallelFor(chunkCount, [&](size_t i) { ParseChunk(chunks[i], fileBegin); });
+
+	for (const Chunk& chunk : chunks) {
+		if (!chunk.error.empty()) {
+			if (err)
+				(*err) += chunk.error;
+			return false;
+		}
+	}
+
+	// 3. fusion des attributs, chaque bloc connait sa position dans les tableaux finaux
+	size_t countV = 0, countVn = 0, countVt = 0;
+	for (Chunk& chunk : chunks) {
+		chunk.offsetV = countV;
+		chunk.offsetVn = countVn;
+		chunk.offsetVt = countVt;
+		countV += chunk.v.size() / 3;
+		countVn += chunk.vn.size() / 3;
+		countVt += chunk.vt.size() / 2;
+	}
+	attrib->vertices.resize(countV * 3);
+	attrib->colors.resize(countV * 3);
+	attrib->normals.resize(countVn * 3);
+	attrib->texcoords.resize(countVt * 2);
+
+	ParallelFor(chunkCount, [&](size_t i) {
+		const Chunk& chunk = chunks[i];
+		if (!chunk.v.empty()) {
+			memcpy(&attrib->vertices[chunk.offsetV * 3], chunk.v.data(), chunk.v.size() * sizeof(float));
+			memcpy(&attrib->colors[chunk.offsetV * 3], chunk.vc.data(), chunk.vc.size() * sizeof(float));
+		}
+		if (!chunk.vn.empty())
+			memcpy(&attrib->normals[chunk.offsetVn * 3], chunk.vn.data(), chunk.vn.size() * sizeof(float));
+		if (!chunk.vt.empty())
+			memcpy(&attrib->texcoords[chunk.offsetVt * 2], chunk.vt.data(), chunk.vt.size() * sizeof(float));
+	});
+
+	// 4. triangulation en parallele (necessite toutes les positions)
+	ParallelFor(chunkCount, [&](size_t i) {
+		chunks[i].v.clear();
+		chunks[i].v.shrink_to_fit();
+		chunks[i].vc.clear();
+		chunks[i].vc.shrink_to_fit();
+		TriangulateChunk(chunks[i], attrib->vertices);
+	});
+
+	// 5. reconstruction sequentielle des shapes en rejouant les commandes dans l'ordre du fichier
+	// la logique (et ses particularites) est celle de tinyobj::LoadObj
+	std::map<std::string, int> material_map;
+	int material = -1;
+	unsigned int current_smoothing_id = 0;
+	std::string name;
+	tinyobj::shape_t shape;
+	std::vector<FaceRun> faceGroup;
+
+	for (const Chunk& chunk : chunks)
+	{
+		for (const Command& command : chunk.commands)
+		{
+			if (command.type == COMMAND_FACES) {
+				faceGroup.push_back({ &chunk, command.first, command.count, current_smoothing_id });
+				continue;
+			}
+
+			// les autres commandes sont rares, on peut se permettre une copie de la ligne
+			const std::string linebuf(fileBegin + command.first, command.count);
+			const char* token = linebuf.c_str();
+
+			switch (command.type)
+			{
+			case COMMAND_USEMTL:
+			{
+				token += 7;
+				std::string namebuf = token;
+				int newMaterialId = -1;
+				auto it = material_map.find(namebuf);
+				if (it != material_map.end())
+					newMaterialId = it->second;
+				if (newMaterialId != material) {
+					ExportGroupsToShape(&shape, faceGroup, material, name);
+					faceGroup.clear();
+					material = newMaterialId;
+				}
+				break;
+			}
+			case COMMAND_MTLLIB:
+			{
+				token += 7;
+				std::vector<std::string> filenames;
+				SplitString(std::string(token), ' ', filenames);
+				if (filenames.empty()) {
+					if (warn)
+						(*warn) += "Looks like empty filename for mtllib. Use default material.\n";
+				}
+				else {
+					bool found = false;
+					for (const std::string& mtlname : filenames) {
+						std::string warn_mtl, err_mtl;
+						bool ok = materialReader(mtlname, materials, &material_map, &warn_mtl, &err_mtl);
+						if (warn && !warn_mtl.empty())
+							(*warn) += warn_mtl;
+						if (err && !err_mtl.empty())
+							(*err) += err_mtl;
+						if (ok) {
+							found = true;
+							break;
+						}
+					}
+					if (!found && warn)
+						(*warn) += "Failed to load material file(s). Use default material.\n";
+				}
+				break;
+			}
+			case COMMAND_GROUP:
+			{
+				ExportGroupsToShape(&shape, faceGroup, material, name);
+				if (shape.mesh.indices.size() > 0)
+					shapes->push_back(shape);
+				shape = tinyobj::shape_t();
+				faceGroup.clear();
+
+				// names[0] vaut "g"
+				std::vector<std::string> names;
+				while (token[0] != '\0' && token[0] != '\r' && token[0] != '\n') {
+					token += strspn(token, " \t");
+					size_t e = strcspn(token, " \t\r");
+					names.push_back(std::string(token, token + e));
+					token += e;
+					token += strspn(token, " \t\r");
+				}
+				if (names.size() < 2) {
+					if (warn) {
+						(*warn) += "Empty group name.\n";
+						name = "";
+					}
+				}
+				else {
+					std::stringstream ss;
+					ss << names[1];
+					for (size_t i = 2; i < names.size(); i++)
+						ss << " " << names[i];
+					name = ss.str();
+				}
+				break;
+			}
+			case COMMAND_OBJECT:
+			{
+				if (ExportGroupsToShape(&shape, faceGroup, material, name))
+					shapes->push_back(shape);
+				faceGroup.clear();
+				shape = tinyobj::shape_t();
+				token += 2;
+				name = token;
+				break;
+			}
+			case COMMAND_SMOOTHING:
+			{
+				token += 2;
+				token += strspn(token, " \t");
+				if (token[0] == '\0')
+					break;
+				if (token[0] == '\r' || token[1] == '\n')
+					break;
+				if (strlen(token) >= 3) {
+					if (token[0] == 'o' && token[1] == 'f' && token[2] == 'f')
+						current_smoothing_id = 0;
+				}
+				else {
+					int smGroupId = atoi(token);
+					current_smoothing_id = smGroupId < 0 ? 0 : (unsigned int)smGroupId;
+				}
+				break;
+			}
+			default:
+				break;
+			}
+		}
+	}
+
+	int greatestV = -1, greatestVn = -1, greatestVt = -1;
+	for (const Chunk& chunk : chunks) {
+		greatestV = chunk.greatestV > greatestV ? chunk.greatestV : greatestV;
+		greatestVn = chunk.greatestVn > greatestVn ? chunk.greatestVn : greatestVn;
+		greatestVt = chunk.greatestVt > greatestVt ? chunk.greatestVt : greatestVt;
+	}
+	if (warn) {
+		if (greatestV >= int(countV))
+			(*warn) += "Vertex indices out of bounds.\n";
+		if (greatestVn >= int(countVn))
+			(*warn) += "Vertex normal indices out of bounds.\n";
+		if (greatestVt >= int(countVt))
+			(*warn) += "Vertex texcoord indices out of bounds.\n";
+	}
+
+	if (ExportGroupsToShape(&shape, faceGroup, material, name) || shape.mesh.indices.size())
+		shapes->push_back(shape);
+
+	return true;
+}
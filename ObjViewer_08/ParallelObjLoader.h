@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "tiny_obj_loader.h"
+
+// Variante multi-thread de tinyobj::LoadObj
+// le fichier est projete en memoire (cf. MappedFile) puis decoupe en autant de blocs que de threads,
+// chaque thread analyse ses lignes (v, vn, vt, f) de maniere independante.
+// Seule la reconstruction des shapes (usemtl, g, o, s) est sequentielle, elle ne fait que concatener
+// des tableaux deja prets.
+// Les donnees produites sont identiques a celles de tinyobj::LoadObj (meme conversion des flottants,
+// meme triangulation) afin que Mesh::ParseObj reste inchange. Les lignes 'l', 'p' et 't' sont ignorees.
+// threadCount = 0 utilise std::thread::hardware_concurrency()
+bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+	std::vector<tinyobj::material_t>* materials, std::string* warn, std::string* err,
+	const char* filename, const char* mtl_basedir = nullptr, uint32_t threadCount = 0);
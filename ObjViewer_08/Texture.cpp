@@ -4,58 +4,325 @@
 #include "stb_image.h"
 
 #include "OpenGLcore.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
 
 uint32_t Texture::CheckExist(const char* path)
 {
-	// "ranged-for" du C++. Equivalent d'un "foreach" en C#
-	for (Texture& tex : textures) {
-		if (tex.name == path)
-			return tex.id;
+	auto it = paths.find(path);
+	return it != paths.end() ? it->second : 0;
+}
+
+// ajoute une reference a une texture deja enregistree (la texture par defaut n'est pas comptee)
+static uint32_t AddReference(uint32_t id)
+{
+	auto it = Texture::textures.find(id);
+	if (it != Texture::textures.end())
+		++it->second.refCount;
+	return id;
+}
+
+// empreinte FNV-1a 64 bits des dimensions et des donnees (pixels RGBA8 ou blocs compresses)
+static uint64_t HashImage(const uint8_t* data, size_t size, int width, int height)
+{
+	uint64_t hash = 14695981039346656037ull;
+	const uint32_t dimensions[2] = { uint32_t(width), uint32_t(height) };
+	const uint8_t* bytes = (const uint8_t*)dimensions;
+	for (size_t i = 0; i < sizeof(dimensions); i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	// les donnees sont traitees par mots de 64 bits, beaucoup plus rapide qu'octet par octet
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(uint64_t));
+		hash = (hash ^ word) * 1099511628211ull;
 	}
-	return 0;
+	for (; i < size; i++)
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	return hash;
+}
+
+// enregistre l'image decodee de path (sans ajouter de reference)
+// si une image identique est deja chargee sous un autre chemin sa texture est reutilisee, sinon create() la cree
+template <typename CreateFunction>
+static uint32_t RegisterImage(const std::string& path, uint64_t hash, const CreateFunction& create)
+{
+	uint32_t textureID;
+	auto same = Texture::contents.find(hash);
+	if (same != Texture::contents.end()) {
+		textureID = same->second;
+		Texture::textures[textureID].names.push_back(path);
+	}
+	else {
+		textureID = create();
+		Texture& texture = Texture::textures[textureID];
+		texture.names.push_back(path);
+		texture.id = textureID;
+		texture.contentHash = hash;
+		texture.refCount = 0;
+		Texture::contents[hash] = textureID;
+	}
+	Texture::paths[path] = textureID;
+	return textureID;
 }
 
 void Texture::SetupManager()
 {
 	// cration d'une texture par dfaut 1x1 blanche
-	if (textures.size() == 0) {
+	if (defaultTexture == 0) {
 		const uint8_t data[] = { 255,255,255,255 };
-		uint32_t textureID = CreateTextureRGBA(1, 1, data);
-		textures.push_back({ "", textureID });
+		defaultTexture = CreateTextureRGBA(1, 1, data);
 	}
 }
 
+void Texture::Release(uint32_t id)
+{
+	auto it = textures.find(id);
+	if (it == textures.end() || --it->second.refCount > 0)
+		return;
+	for (const std::string& name : it->second.names)
+		paths.erase(name);
+	contents.erase(it->second.contentHash);
+	TextureStreamer::Cancel(id);
+	GLState::DeleteTextures(1, &id);
+	textures.erase(it);
+}
+
 void Texture::PurgeTextures()
 {
-	for (uint32_t i = 0; i < Texture::textures.size(); ++i)
+	for (auto& entry : textures)
 	{
-		glDeleteTextures(1, &Texture::textures[i].id);
+		TextureStreamer::Cancel(entry.second.id);
+		GLState::DeleteTextures(1, &entry.second.id);
 	}
-	// change le nombre d'element (size)  zero, mais conserve la meme capacite
-	textures.clear();
-	// force capacite = size
-	textures.shrink_to_fit();
+	GLState::DeleteTextures(1, &defaultTexture);
+	defaultTexture = 0;
+	// clear() conserve les "buckets" des tables, l'echange avec des tables vides libere aussi cette memoire
+	std::unordered_map<uint32_t, Texture>().swap(textures);
+	std::unordered_map<std::string, uint32_t>().swap(paths);
+	std::unordered_map<uint64_t, uint32_t>().swap(contents);
+}
+
+// envoi d'une texture cuisinee (mipmaps calcules sur le CPU, cf. TextureCache::Cook), niveau par niveau
+static uint32_t CreateCookedTexture(const TextureCache::Image& image)
+{
+	const void* levels[TextureCache::MAX_LEVEL_COUNT];
+	for (uint32_t level = 0; level < image.levelCount; level++)
+		levels[level] = image.Level(level);
+	return CreateTexture(image.Desc(), levels);
 }
 
 uint32_t Texture::LoadTexture(const char* path)
 {
-	uint32_t textureID = Texture::CheckExist(path);
-	if (textureID > 0)
-		return textureID;
+	// meme chemin que les lots (DecodeImage puis RegisterImage) : meme empreinte et meme espace sRGB,
+	// une image chargee par l'une ou l'autre fonction est reconnue par la deduplication
+	uint32_t textureID = 0;
+	LoadTextures(&path, &textureID, 1);
+	return textureID;
+}
+
+// image decodee et cuisinee par un thread de LoadTextures, en attente de l'envoi au GPU
+struct DecodedImage
+{
+	std::string path;
+	TextureCache::Image cooked;	// chaine de mipmaps (levelCount = 0 si l'image est illisible)
+	bool fromCache;			// lue depuis le fichier .btex
+	int width, height;
+	uint64_t hash;			// cf. HashImage, calcule par le thread de decodage
+	double decodeTime;		// en ms, sur le thread de decodage (lecture du cache le cas echeant)
+	double cookTime;		// mipmaps et compression
+	bool decoded;			// protege par le mutex de LoadTextures
+	uint32_t id;
+
+	DecodedImage(const char* p) : path(p), fromCache(false), width(0), height(0), hash(0)
+		, decodeTime(0.0), cookTime(0.0), decoded(false), id(0) {}
+};
+
+// executee par les threads de LoadTextures : lecture du cache .btex, sinon decodage, mipmaps (et compression)
+static void DecodeImage(DecodedImage& image, const Texture::LoadOptions& options, uint32_t cookThreads)
+{
+	auto decodeStart = std::chrono::high_resolution_clock::now();
+	FileStamp stamp;
+	std::string cachePath;
+	// la compression est trop couteuse pour etre refaite a chaque lancement, elle est toujours mise en cache
+	if ((options.useCache || options.compress) && FileStamp::Get(image.path.c_str(), &stamp))
+	{
+		cachePath = TextureCache::PathFor(image.path.c_str(), options.cacheDirectory);
+		image.fromCache = TextureCache::Load(cachePath.c_str(), stamp, options.compress, &image.cooked);
+	}
+	uint8_t* data = nullptr;
+	if (!image.fromCache)
+	{
+		int c;
+		data = stbi_load(image.path.c_str(), &image.width, &image.height, &c, STBI_rgb_alpha);
+	}
+	image.decodeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - decodeStart).count();
 
-	int width, height, c;
-	uint8_t* data = stbi_load(path, &width, &height, &c, STBI_rgb_alpha);
-	if (data == nullptr) {
-		// la premiere texture dans le texture manager est la texture par defaut blanche
-		return textures[0].id;
+	if (data)
+	{
+		auto cookStart = std::chrono::high_resolution_clock::now();
+		TextureCache::Cook(&image.cooked, data, image.width, image.height, options.compress, true, cookThreads);
+		stbi_image_free(data);
+		// le resultat de Cook est deterministe : deux images identiques ont la meme empreinte
+		// elle est conservee dans le cache, les lancements suivants ne relisent pas les niveaux pour la calculer
+		image.cooked.contentHash = HashImage(image.cooked.data.data(), image.cooked.data.size(), image.cooked.width, image.cooked.height)
+			^ image.cooked.format;
+		if (!cachePath.empty() && !TextureCache::Save(cachePath.c_str(), stamp, image.cooked))
+			std::cout << "[warning]: impossible d'ecrire le cache " << cachePath << std::endl;
+		image.cookTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - cookStart).count();
 	}
 
-	textureID = CreateTextureRGBA(width, height, data, true);
-	stbi_image_free(data);
+	if (image.cooked.levelCount > 0) {
+		image.width = int(image.cooked.width);
+		image.height = int(image.cooked.height);
+		image.hash = image.cooked.contentHash;
+	}
+}
 
-	textures.push_back({ path, textureID });
-	return textureID;
+void Texture::LoadTextures(const char* const* paths, uint32_t* ids, size_t count, const LoadOptions& options)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// chaque fichier n'est decode qu'une fois, meme s'il est utilise par plusieurs materiaux
+	std::vector<DecodedImage> images;
+	std::vector<size_t> imageIndex(count, SIZE_MAX);
+	std::map<std::string, size_t> pending;
+	for (size_t i = 0; i < count; i++)
+	{
+		ids[i] = CheckExist(paths[i]);
+		if (ids[i] > 0) {
+			AddReference(ids[i]);
+			continue;
+		}
+		auto it = pending.insert({ paths[i], images.size() });
+		if (it.second)
+			images.emplace_back(paths[i]);
+		imageIndex[i] = it.first->second;
+	}
+	if (images.empty())
+		return;
+
+	uint32_t threadCount = options.threadCount;
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	const uint32_t coreCount = threadCount;
+	threadCount = uint32_t(std::min<size_t>(threadCount, images.size()));
+	// les coeurs non utilises par le decodage (moins d'images que de coeurs) servent aux mipmaps et a la compression
+	const uint32_t cookThreads = std::max(1u, coreCount / threadCount);
+	// les niveaux sont alors copies dans les PBO du streamer au fil des frames, hors de cette fonction
+	const bool stream = options.stream && TextureStreamer::IsInitialized();
+
+	// les threads prennent les images dans l'ordre, le thread GL envoie chaque image des qu'elle est prete
+	// note: stbi_load est reentrant tant que les options globales (stbi_set_flip_vertically_on_load...) ne changent pas
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::atomic<size_t> nextImage(0);
+	std::vector<std::thread> workers;
+	workers.reserve(threadCount);
+	for (uint32_t t = 0; t < threadCount; t++)
+	{
+		workers.emplace_back([&]() {
+			for (size_t i = nextImage++; i < images.size(); i = nextImage++)
+			{
+				DecodeImage(images[i], options, cookThreads);
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					images[i].decoded = true;
+				}
+				ready.notify_one();
+			}
+		});
+	}
+
+	double decodeTotal = 0.0, cookTotal = 0.0, uploadTotal = 0.0;
+	size_t uploadBytes = 0, rgbaBytes = 0;
+	std::vector<bool> uploaded(images.size(), false);
+	for (size_t done = 0; done < images.size(); done++)
+	{
+		// premiere image decodee et pas encore envoyee
+		size_t i = 0;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ready.wait(lock, [&]() {
+				for (i = 0; i < images.size(); i++)
+					if (images[i].decoded && !uploaded[i])
+						return true;
+				return false;
+			});
+		}
+		uploaded[i] = true;
+		DecodedImage& image = images[i];
+		if (image.cooked.levelCount == 0) {
+			// la texture par defaut est blanche
+			image.id = defaultTexture;
+			continue;
+		}
+
+		auto uploadStart = std::chrono::high_resolution_clock::now();
+		const bool duplicate = contents.count(image.hash) > 0;
+		image.id = RegisterImage(image.path, image.hash, [&]() {
+			for (uint32_t level = 0; level < image.cooked.levelCount; level++)
+				uploadBytes += image.cooked.levelSizes[level];
+			if (stream)
+				return TextureStreamer::Enqueue(std::move(image.cooked));
+			return CreateCookedTexture(image.cooked);
+		});
+		const double uploadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - uploadStart).count();
+		if (!duplicate)
+			rgbaBytes += size_t(image.width) * image.height * 4 * 4 / 3;
+		image.cooked.data = std::vector<uint8_t>();
+		image.cooked.file.reset();
+
+		decodeTotal += image.decodeTime;
+		cookTotal += image.cookTime;
+		uploadTotal += uploadTime;
+		if (options.verbose)
+		{
+			std::cout << "[Texture] " << image.path << " (" << image.width << "x" << image.height;
+			if (image.cooked.format != TextureCache::FORMAT_RGBA8)
+				std::cout << (image.cooked.format == TextureCache::FORMAT_BC3 ? ", BC3" : ", BC1");
+			std::cout << ", " << image.cooked.levelCount << " niveaux";
+			std::cout << ") : " << (image.fromCache ? "lecture du cache " : "decodage ") << image.decodeTime << " ms, ";
+			if (image.cookTime > 0.0)
+				std::cout << (options.compress ? "mipmaps et compression " : "mipmaps ") << image.cookTime << " ms, ";
+			if (duplicate)
+				std::cout << "contenu identique a une texture deja chargee" << std::endl;
+			else
+				std::cout << (stream ? "mise en file d'envoi " : "envoi ") << uploadTime << " ms" << std::endl;
+		}
+	}
+	for (std::thread& worker : workers)
+		worker.join();
+
+	for (size_t i = 0; i < count; i++) {
+		if (imageIndex[i] != SIZE_MAX)
+			ids[i] = AddReference(images[imageIndex[i]].id);
+	}
+
+	if (options.verbose)
+	{
+		const double totalTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		std::cout << "[Texture] " << images.size() << " images sur " << threadCount << " threads : decodage " << decodeTotal
+			<< " ms (cumule), ";
+		std::cout << (options.compress ? "mipmaps et compression " : "mipmaps ") << cookTotal << " ms (cumule), ";
+		std::cout << (stream ? "mise en file d'envoi " : "envoi ") << uploadTotal << " ms, total " << totalTime << " ms" << std::endl;
+		if (options.compress)
+			std::cout << "[Texture] memoire video (mipmaps compris) : " << rgbaBytes << " octets en RGBA8 -> " << uploadBytes << " octets" << std::endl;
+	}
 }
 
 // version trs basique d'un texture manager
-std::vector<Texture> Texture::textures;
\ No newline at end of file
+std::unordered_map<uint32_t, Texture> Texture::textures;
+std::unordered_map<std::string, uint32_t> Texture::paths;
+std::unordered_map<uint64_t, uint32_t> Texture::contents;
+uint32_t Texture::defaultTexture = 0;
\ No newline at end of file
@@ -1,22 +1,56 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+// version basique d'un texture manager
+// - recherche d'un chemin en O(1) (table de hachage)
+// - deduplication par contenu : deux fichiers dont les pixels sont identiques partagent la meme texture OpenGL
+// - comptage de references : LoadTexture/LoadTextures ajoutent une reference par identifiant retourne,
+//   Release() la rend et la texture est detruite des qu'elle n'est plus utilisee (cf. Mesh::Destroy)
+// la texture par defaut (blanche) n'est pas comptee, elle n'est detruite que par PurgeTextures()
 struct Texture
 {
-	std::string name;
+	std::vector<std::string> names;	// chemins qui designent cette texture
 	uint32_t id;
+	uint64_t contentHash;			// empreinte des pixels et des dimensions
+	uint32_t refCount;
 	//uint8_t* albedo;
 	//int width;
 	//int height;
 	//int bpp;
 
+	// options de LoadTextures
+	struct LoadOptions
+	{
+		uint32_t threadCount;		// threads de decodage (et de compression), 0 = nombre de coeurs
+		bool verbose;				// affiche les temps de decodage et d'envoi au GPU de chaque texture
+		bool useCache;				// textures cuisinees (mipmaps) mises en cache sur disque (cf. TextureCache.h)
+		bool compress;				// compression BC1/BC3, toujours mise en cache
+		bool stream;				// envoi au GPU differe et etale sur plusieurs frames (cf. TextureStreamer.h, si initialise)
+		const char* cacheDirectory;	// repertoire des fichiers .btex, nullptr = a cote des images
+
+		LoadOptions() : threadCount(0), verbose(false), useCache(false), compress(false), stream(false), cacheDirectory(nullptr) {}
+	};
+
+	// equivalent a LoadTextures pour une seule image, avec les options par defaut
 	static uint32_t LoadTexture(const char* path);
-	
-	// version tres basique d'un texture manager
-	static std::vector<Texture> textures;
+	// chargement d'un lot de textures (materiaux d'un OBJ) : le decodage des images (stbi_load) et le calcul
+	// des mipmaps sont repartis sur plusieurs threads, seule la creation des textures OpenGL a lieu sur le thread
+	// appelant (celui du contexte GL), au fur et a mesure que les images sont pretes.
+	// ids[i] recoit l'identifiant de paths[i], la texture par defaut si le fichier est illisible
+	static void LoadTextures(const char* const* paths, uint32_t* ids, size_t count, const LoadOptions& options = LoadOptions());
+	// rend une reference, la texture OpenGL est detruite a la derniere
+	static void Release(uint32_t id);
+
+	static std::unordered_map<uint32_t, Texture> textures;		// indexees par identifiant OpenGL
+	static std::unordered_map<std::string, uint32_t> paths;		// chemin -> identifiant
+	static std::unordered_map<uint64_t, uint32_t> contents;		// empreinte du contenu -> identifiant
+	static uint32_t defaultTexture;
 	static void SetupManager();
+	// 0 si le chemin n'a pas encore ete charge, n'ajoute pas de reference
 	static uint32_t CheckExist(const char* path);
 	static void PurgeTextures();
-};
\ No newline at end of file
+};
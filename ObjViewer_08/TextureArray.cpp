@@ -0,0 +1,103 @@
+#include "TextureArray.h"
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "OpenGLcore.h"
+
+// caracteristiques communes aux couches d'un tableau
+struct TextureFormat
+{
+	int32_t internalFormat;
+	int32_t width, height;
+	int32_t levelCount;
+
+	bool operator<(const TextureFormat& other) const
+	{
+		return std::tie(internalFormat, width, height, levelCount)
+			< std::tie(other.internalFormat, other.width, other.height, other.levelCount);
+	}
+};
+
+static TextureFormat QueryFormat(uint32_t texture)
+{
+	TextureFormat format;
+	GLState::BindTexture(0, GL_TEXTURE_2D, texture);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format.internalFormat);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &format.width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &format.height);
+	// GL_TEXTURE_MAX_LEVEL vaut 1000 par defaut (texture sans mipmaps), on le borne a la chaine complete
+	int32_t maxLevel = 0, fullChain = 1;
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+	while ((std::max(format.width, format.height) >> fullChain) > 0)
+		fullChain++;
+	format.levelCount = std::min(maxLevel + 1, fullChain);
+	return format;
+}
+
+// allocation de tous les niveaux du tableau, contenu indefini
+static uint32_t CreateArray(const TextureFormat& format, uint32_t layerCount)
+{
+	TextureDesc desc(format.width, format.height, format.internalFormat, format.levelCount);
+	desc.target = GL_TEXTURE_2D_ARRAY;
+	desc.layerCount = layerCount;
+	return CreateTexture(desc);
+}
+
+uint32_t PackTextureArrays(const uint32_t* textures, size_t count, uint32_t* arrays, uint32_t maxArrays, TextureLayer* layers)
+{
+	for (size_t i = 0; i < count; i++)
+		layers[i] = { -1, 0 };
+	if (!GLEW_ARB_copy_image)
+		return 0;
+
+	// textures distinctes groupees par format, dans l'ordre de premiere apparition
+	struct Group
+	{
+		TextureFormat format;
+		std::vector<uint32_t> members;
+	};
+	std::vector<Group> groups;
+	std::map<TextureFormat, size_t> groupIndex;
+	std::map<uint32_t, TextureLayer> locations;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (locations.count(textures[i]) > 0)
+			continue;
+		locations[textures[i]] = { -1, 0 };
+		const TextureFormat format = QueryFormat(textures[i]);
+		auto it = groupIndex.insert({ format, groups.size() });
+		if (it.second)
+			groups.push_back({ format, {} });
+		groups[it.first->second].members.push_back(textures[i]);
+	}
+
+	// les groupes les plus nombreux economisent le plus de changements de texture
+	std::stable_sort(groups.begin(), groups.end(), [](const Group& a, const Group& b) {
+		return a.members.size() > b.members.size();
+	});
+	const uint32_t arrayCount = std::min(maxArrays, uint32_t(groups.size()));
+
+	for (uint32_t a = 0; a < arrayCount; a++)
+	{
+		const TextureFormat& format = groups[a].format;
+		const std::vector<uint32_t>& members = groups[a].members;
+		arrays[a] = CreateArray(format, uint32_t(members.size()));
+		for (uint32_t layer = 0; layer < members.size(); layer++)
+		{
+			// copie GPU -> GPU de chaque niveau, sans passer par la memoire centrale
+			for (int32_t level = 0; level < format.levelCount; level++)
+				glCopyImageSubData(members[layer], GL_TEXTURE_2D, level, 0, 0, 0, arrays[a], GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+					std::max(1, format.width >> level), std::max(1, format.height >> level), 1);
+			locations[members[layer]] = { int32_t(a), layer };
+		}
+	}
+	GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+
+	for (size_t i = 0; i < count; i++)
+		layers[i] = locations[textures[i]];
+	return arrayCount;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Regroupement des textures de materiaux en GL_TEXTURE_2D_ARRAY
+// chaque texture devient une couche (layer) d'un tableau qui contient toutes les textures de meme format interne,
+// dimensions et nombre de niveaux. Les tableaux sont lies une fois pour toutes a des unites de texture distinctes,
+// un materiau ne designe plus qu'un tableau et une couche (uniformes) : plus aucun glBindTexture entre deux SubMesh.
+// Les textures de tailles differentes ne sont pas reunies dans un atlas : les uv des OBJ depassent souvent [0;1]
+// (repetition) et les mipmaps d'un atlas melangent les textures voisines.
+
+// nombre maximum de tableaux, cf. u_DiffuseArrays dans opaque.fs.glsl
+static const uint32_t MAX_TEXTURE_ARRAYS = 8;
+
+struct TextureLayer
+{
+	int32_t array;		// indice dans le tableau arrays de PackTextureArrays, -1 si la texture n'a pas ete regroupee
+	uint32_t layer;
+};
+
+// textures : identifiants GL_TEXTURE_2D dont tous les niveaux sont envoyes (cf. TextureStreamer), doublons autorises
+// le contenu est copie par le GPU (glCopyImageSubData, OpenGL 4.3 ou GL_ARB_copy_image), les textures d'origine
+// ne sont pas modifiees. S'il y a plus de maxArrays groupes, ceux qui reunissent le plus de textures sont retenus.
+// layers[i] recoit l'emplacement de textures[i], retourne le nombre de tableaux crees dans arrays (0 sans GL_ARB_copy_image)
+uint32_t PackTextureArrays(const uint32_t* textures, size_t count, uint32_t* arrays, uint32_t maxArrays, TextureLayer* layers);
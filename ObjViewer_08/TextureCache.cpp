@@ -0,0 +1,289 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#define STB_DXT_IMPLEMENTATION
+#include "stb_dxt.h"
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include "stb_image_resize.h"
+
+#include "OpenGLcore.h"
+
+static_assert(sizeof(TextureCache::Header) == 184, "le format du cache ne doit pas dependre du compilateur");
+
+static const uint32_t LEVEL_ALIGNMENT = 16;
+
+static inline uint32_t AlignLevel(uint32_t offset)
+{
+	return (offset + LEVEL_ALIGNMENT - 1) & ~(LEVEL_ALIGNMENT - 1);
+}
+
+// lignes d'un niveau en dessous desquelles le redimensionnement n'est pas decoupe entre plusieurs threads
+static const uint32_t MIN_ROWS_PER_THREAD = 32;
+
+// niveau de mipmap RGBA8 non compresse, pixels pointe dans la chaine complete
+struct MipLevel
+{
+	uint32_t width, height;
+	uint8_t* pixels;
+};
+
+static uint32_t LevelSize(TextureCache::Format format, uint32_t width, uint32_t height)
+{
+	if (format == TextureCache::FORMAT_RGBA8)
+		return width * height * 4;
+	const uint32_t blockSize = format == TextureCache::FORMAT_BC3 ? 16 : 8;
+	return ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+// execute fn(begin, end) sur des intervalles contigus de [0, count[, un par thread (le thread appelant compris)
+template <typename Function>
+static void ParallelRows(uint32_t count, uint32_t threadCount, const Function& fn)
+{
+	const uint32_t rangeCount = std::max(1u, std::min(threadCount, count / MIN_ROWS_PER_THREAD));
+	std::vector<std::thread> workers;
+	for (uint32_t r = 1; r < rangeCount; r++)
+		workers.emplace_back([&fn, r, rangeCount, count]() { fn(count * r / rangeCount, count * (r + 1) / rangeCount); });
+	fn(0, count / rangeCount);
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+// niveau suivant par stb_image_resize (filtre de Mitchell, alpha pondere)
+// srgb : les couleurs sont linearisees avant filtrage puis re-encodees, sinon une texture sRGB s'assombrit a distance
+// chaque thread calcule une bande de lignes de destination, le resultat est identique a un seul appel
+static void Downsample(const MipLevel& destination, const MipLevel& source, bool srgb, uint32_t threadCount)
+{
+	const float scaleX = float(destination.width) / float(source.width);
+	const float scaleY = float(destination.height) / float(source.height);
+	ParallelRows(destination.height, threadCount, [&](uint32_t begin, uint32_t end) {
+		stbir_resize_subpixel(source.pixels, int(source.width), int(source.height), 0,
+			destination.pixels + size_t(begin) * destination.width * 4, int(destination.width), int(end - begin), 0,
+			STBIR_TYPE_UINT8, 4, 3, 0, STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP, STBIR_FILTER_MITCHELL, STBIR_FILTER_MITCHELL,
+			srgb ? STBIR_COLORSPACE_SRGB : STBIR_COLORSPACE_LINEAR, nullptr, scaleX, scaleY, 0.f, float(begin));
+	});
+}
+
+// compresse le bloc de 4x4 pixels (bx, by), les blocs du bord repetent le dernier pixel
+static void CompressBlock(uint8_t* destination, const MipLevel& level, uint32_t bx, uint32_t by, bool alpha)
+{
+	uint8_t block[16 * 4];
+	for (uint32_t y = 0; y < 4; y++) {
+		const uint32_t sy = std::min(by * 4 + y, level.height - 1);
+		for (uint32_t x = 0; x < 4; x++) {
+			const uint32_t sx = std::min(bx * 4 + x, level.width - 1);
+			memcpy(&block[(y * 4 + x) * 4], &level.pixels[(size_t(sy) * level.width + sx) * 4], 4);
+		}
+	}
+	stb_compress_dxt_block(destination, block, alpha ? 1 : 0, STB_DXT_HIGHQUAL);
+}
+
+namespace TextureCache
+{
+	uint32_t Image::InternalFormat() const
+	{
+		switch (format)
+		{
+		case FORMAT_BC1: return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case FORMAT_BC3: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		default: return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+		}
+	}
+
+	TextureDesc Image::Desc() const
+	{
+		return TextureDesc(width, height, InternalFormat(), levelCount);
+	}
+
+	std::string PathFor(const char* sourcePath, const char* cacheDirectory)
+	{
+		std::string path = sourcePath;
+		size_t slash = path.find_last_of("/\\");
+		size_t dot = path.rfind('.');
+		if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+			path.resize(dot);
+		path += ".btex";
+
+		if (cacheDirectory == nullptr)
+			return path;
+		// on ne garde que le nom du fichier
+		std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+		return std::string(cacheDirectory) + "/" + name;
+	}
+
+	void Cook(Image* image, const uint8_t* rgba, uint32_t width, uint32_t height, bool compress, bool srgb, uint32_t threadCount)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		// les niveaux sont ecrits dans data, l'image ne designe plus un fichier projete
+		image->file.reset();
+		image->fileData = nullptr;
+
+		// 1. chaine de mipmaps RGBA8 jusqu'a 1x1 (arrondi inferieur des dimensions, comme OpenGL)
+		uint32_t levelCount = 1;
+		while (((width | height) >> levelCount) != 0 && levelCount < MAX_LEVEL_COUNT)
+			levelCount++;
+		std::vector<MipLevel> levels(levelCount);
+		std::vector<size_t> pixelOffsets(levelCount);
+		size_t pixelBytes = 0;
+		for (uint32_t level = 0; level < levelCount; level++) {
+			levels[level].width = std::max(1u, width >> level);
+			levels[level].height = std::max(1u, height >> level);
+			pixelOffsets[level] = pixelBytes;
+			pixelBytes = AlignLevel(uint32_t(pixelBytes + LevelSize(FORMAT_RGBA8, levels[level].width, levels[level].height)));
+		}
+		std::vector<uint8_t> pixels(pixelBytes);
+		for (uint32_t level = 0; level < levelCount; level++)
+			levels[level].pixels = pixels.data() + pixelOffsets[level];
+		memcpy(levels[0].pixels, rgba, size_t(width) * height * 4);
+		for (uint32_t level = 1; level < levelCount; level++)
+			Downsample(levels[level], levels[level - 1], srgb, threadCount);
+
+		bool alpha = false;
+		for (size_t i = 3; i < size_t(width) * height * 4 && !alpha; i += 4)
+			alpha = rgba[i] != 255;
+
+		image->format = !compress ? FORMAT_RGBA8 : alpha ? FORMAT_BC3 : FORMAT_BC1;
+		image->srgb = srgb;
+		image->width = width;
+		image->height = height;
+		image->levelCount = levelCount;
+		uint32_t offset = 0;
+		for (uint32_t level = 0; level < levelCount; level++) {
+			image->levelOffsets[level] = offset;
+			image->levelSizes[level] = LevelSize(image->format, levels[level].width, levels[level].height);
+			offset = AlignLevel(offset + image->levelSizes[level]);
+		}
+		if (!compress) {
+			image->data.swap(pixels);
+			return;
+		}
+		image->data.assign(offset, 0);
+
+		// 2. compression : chaque tache est une ligne de blocs d'un niveau
+		// stb_dxt initialise ses tables au premier appel, on le fait avant de lancer les threads
+		static std::once_flag initialized;
+		std::call_once(initialized, []() {
+			uint8_t block[16 * 4] = {}, result[16];
+			stb_compress_dxt_block(result, block, 1, STB_DXT_NORMAL);
+		});
+		struct Row { uint32_t level, by; };
+		std::vector<Row> rows;
+		for (uint32_t level = 0; level < levelCount; level++)
+			for (uint32_t by = 0; by < (levels[level].height + 3) / 4; by++)
+				rows.push_back({ level, by });
+
+		const uint32_t blockSize = alpha ? 16 : 8;
+		std::atomic<size_t> nextRow(0);
+		auto compressRows = [&]() {
+			for (size_t r = nextRow++; r < rows.size(); r = nextRow++)
+			{
+				const MipLevel& level = levels[rows[r].level];
+				const uint32_t blocksX = (level.width + 3) / 4;
+				uint8_t* destination = image->data.data() + image->levelOffsets[rows[r].level] + size_t(rows[r].by) * blocksX * blockSize;
+				for (uint32_t bx = 0; bx < blocksX; bx++)
+					CompressBlock(destination + bx * blockSize, level, bx, rows[r].by, alpha);
+			}
+		};
+
+		threadCount = uint32_t(std::min<size_t>(threadCount, rows.size()));
+		std::vector<std::thread> workers;
+		for (uint32_t t = 1; t < threadCount; t++)
+			workers.emplace_back(compressRows);
+		compressRows();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	bool Save(const char* cachePath, const FileStamp& source, const Image& image)
+	{
+		Header header;
+		memset(&header, 0, sizeof(Header));
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.format = image.format;
+		header.width = image.width;
+		header.height = image.height;
+		header.levelCount = image.levelCount;
+		header.source = source;
+		header.flags = image.srgb ? uint32_t(FLAG_SRGB) : 0u;
+		header.contentHash = image.contentHash;
+		const uint32_t dataOffset = AlignLevel(sizeof(Header));
+		for (uint32_t level = 0; level < image.levelCount; level++) {
+			header.levelOffsets[level] = dataOffset + image.levelOffsets[level];
+			header.levelSizes[level] = image.levelSizes[level];
+		}
+
+		std::string tempPath = std::string(cachePath) + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out)
+				return false;
+			static const char zeros[LEVEL_ALIGNMENT] = {};
+			out.write((const char*)&header, sizeof(Header));
+			out.write(zeros, dataOffset - sizeof(Header));
+			out.write((const char*)image.data.data(), image.data.size());
+			if (!out) {
+				out.close();
+				std::remove(tempPath.c_str());
+				return false;
+			}
+		}
+
+		// std::rename ne remplace pas un fichier existant sous Windows
+		std::remove(cachePath);
+		return std::rename(tempPath.c_str(), cachePath) == 0;
+	}
+
+	bool Load(const char* cachePath, const FileStamp& source, bool compressed, Image* image)
+	{
+		std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>();
+		const MappedFile& file = *mapping;
+		if (!mapping->Open(cachePath) || file.size < sizeof(Header))
+			return false;
+		const Header* h = (const Header*)file.data;
+		if (h->magic != MAGIC || h->version != VERSION || (h->format != FORMAT_RGBA8 && h->format != FORMAT_BC1 && h->format != FORMAT_BC3))
+			return false;
+		// le fichier doit correspondre a l'option de compression demandee
+		if ((h->format != FORMAT_RGBA8) != compressed)
+			return false;
+		if (h->source.size != source.size || h->source.modificationTime != source.modificationTime)
+			return false;
+		if (h->width == 0 || h->height == 0 || h->levelCount == 0 || h->levelCount > MAX_LEVEL_COUNT)
+			return false;
+
+		// verification des bornes, un fichier tronque ne doit pas provoquer de lecture hors projection
+		const uint32_t dataOffset = AlignLevel(sizeof(Header));
+		for (uint32_t level = 0; level < h->levelCount; level++) {
+			if (h->levelSizes[level] != LevelSize(Format(h->format), std::max(1u, h->width >> level), std::max(1u, h->height >> level)))
+				return false;
+			// les niveaux se suivent dans le fichier
+			if (level > 0 && h->levelOffsets[level] < h->levelOffsets[level - 1] + h->levelSizes[level - 1])
+				return false;
+			if (h->levelOffsets[level] < dataOffset || h->levelOffsets[level] > file.size || h->levelSizes[level] > file.size - h->levelOffsets[level])
+				return false;
+		}
+
+		image->format = Format(h->format);
+		image->width = h->width;
+		image->height = h->height;
+		image->levelCount = h->levelCount;
+		image->srgb = (h->flags & FLAG_SRGB) != 0;
+		image->contentHash = h->contentHash;
+		// aucune copie : seules les pages des niveaux envoyes seront lues
+		image->data.clear();
+		image->file = mapping;
+		image->fileData = file.data + dataOffset;
+		for (uint32_t level = 0; level < h->levelCount; level++) {
+			image->levelOffsets[level] = h->levelOffsets[level] - dataOffset;
+			image->levelSizes[level] = h->levelSizes[level];
+		}
+		return true;
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MeshCache.h"		// FileStamp
+#include "MappedFile.h"
+#include "OpenGLcore.h"		// TextureDesc
+
+// Cache de textures "cuisinees" (cooked)
+// chaque texture est decodee (stbi_load) une seule fois, sa chaine de mipmaps est calculee sur le CPU
+// (stb_image_resize, filtrage dans l'espace lineaire pour les couleurs sRGB) puis eventuellement compressee
+// en BC1 (DXT1, opaque, 8 octets par bloc de 4x4) ou BC3 (DXT5, avec alpha, 16 octets par bloc), cf. stb_dxt.h
+// Le resultat est ecrit a cote de l'image (extension .btex) et transmis niveau par niveau a OpenGL
+// aux lancements suivants : ni decodage, ni glGenerateMipmap (resultat identique quel que soit le driver),
+// et 4 a 8 fois moins de memoire video que GL_RGBA8 avec la compression.
+//
+// Organisation du fichier : Header | niveau 0 | niveau 1 | ... (chaque niveau aligne sur 16 octets)
+// Le cache est invalide lorsque la taille ou la date de modification de l'image source changent.
+// Load ne lit que l'en-tete : les niveaux sont lus dans le fichier projete au moment de leur envoi (cf. TextureStreamer),
+// la queue de mipmaps d'abord, le premier affichage n'attend pas la lecture des niveaux fins.
+
+namespace TextureCache
+{
+	static constexpr uint32_t MAGIC = 0x58455442;	// "BTEX" en little endian
+	static constexpr uint32_t VERSION = 4;			// 3 : espace colorimetrique (flags), 4 : empreinte du contenu
+	static constexpr uint32_t MAX_LEVEL_COUNT = 16;	// 32768 x 32768
+
+	enum Format : uint32_t
+	{
+		FORMAT_RGBA8 = 0,	// non compresse
+		FORMAT_BC1 = 1,		// GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+		FORMAT_BC3 = 3		// GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+	};
+
+	enum Flags : uint32_t
+	{
+		FLAG_SRGB = 1		// couleurs encodees en sRGB, texture creee avec le format interne SRGB correspondant
+	};
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+		FileStamp source;
+		uint32_t levelOffsets[MAX_LEVEL_COUNT];		// offsets en octets depuis le debut du fichier
+		uint32_t levelSizes[MAX_LEVEL_COUNT];
+		uint32_t flags;
+		uint32_t padding;				// alignement de contentHash
+		uint64_t contentHash;			// cf. Image::contentHash
+	};
+
+	// texture compressee en memoire, levelOffsets sont relatifs au debut de data
+	struct Image
+	{
+		Format format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+		uint32_t levelOffsets[MAX_LEVEL_COUNT];
+		uint32_t levelSizes[MAX_LEVEL_COUNT];
+		bool srgb;
+		// empreinte des niveaux, calculee par l'appelant de Cook (cf. Texture.cpp) et conservee dans le cache :
+		// deux images identiques sont reconnues sans relire leurs niveaux
+		uint64_t contentHash;
+		std::vector<uint8_t> data;
+		// image lue depuis le cache : les niveaux restent dans le fichier projete (data est vide), partage par les copies
+		std::shared_ptr<MappedFile> file;
+		const uint8_t* fileData;
+
+		Image() : format(FORMAT_BC1), width(0), height(0), levelCount(0), srgb(true), contentHash(0), fileData(nullptr) {}
+
+		const uint8_t* Level(uint32_t level) const { return (file ? fileData : data.data()) + levelOffsets[level]; }
+		// format interne OpenGL correspondant (GL_SRGB8_ALPHA8... si srgb) et description pour CreateTexture
+		uint32_t InternalFormat() const;
+		TextureDesc Desc() const;
+	};
+
+	// chemin du fichier cache : a cote de l'image (extension remplacee par .btex)
+	// ou dans cacheDirectory si celui-ci est precise
+	std::string PathFor(const char* sourcePath, const char* cacheDirectory = nullptr);
+
+	// calcule la chaine de mipmaps de l'image RGBA8 puis, si compress, compresse tous les niveaux
+	// (BC3 si au moins un pixel est transparent, BC1 sinon). srgb : couleurs encodees en sRGB (filtrage gamma correct)
+	// le redimensionnement et la compression sont repartis sur threadCount threads (0 = nombre de coeurs)
+	void Cook(Image* image, const uint8_t* rgba, uint32_t width, uint32_t height, bool compress, bool srgb = true, uint32_t threadCount = 0);
+
+	// ecrit d'abord un fichier temporaire puis le renomme, un cache incomplet n'est jamais lu
+	bool Save(const char* cachePath, const FileStamp& source, const Image& image);
+	// echoue si le fichier est absent, corrompu, perime ou si son format ne correspond pas a compressed
+	// le fichier reste projete tant que image (ou une copie) existe, les niveaux n'en sont lus qu'a l'utilisation
+	bool Load(const char* cachePath, const FileStamp& source, bool compressed, Image* image);
+}
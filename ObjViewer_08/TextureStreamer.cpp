@@ -0,0 +1,320 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "OpenGLcore.h"
+
+// alignement des morceaux dans un PBO (blocs BC3 de 16 octets)
+static const uint32_t CHUNK_ALIGNMENT = 16;
+
+// texture en attente : les niveaux sont envoyes du plus grossier au plus fin, par groupes de lignes (de blocs pour BC1/BC3)
+struct Job
+{
+	uint32_t texture;
+	TextureCache::Image image;
+	uint32_t level;		// niveau en cours d'envoi, les niveaux suivants (plus grossiers) sont deja envoyes
+	uint32_t row;		// prochaine ligne du niveau
+	float pixelSize;	// taille a l'ecran demandee lors de la derniere frame (cf. Request), 0 si invisible
+};
+
+// morceau d'un niveau copie dans le PBO courant, glTexSubImage2D est appele une fois le PBO rempli
+struct Chunk
+{
+	uint32_t texture;
+	uint32_t internalFormat;
+	uint32_t level;
+	uint32_t y, width, height;	// en pixels
+	uint32_t offset, size;		// en octets dans le PBO
+};
+
+// niveau dont le dernier morceau a ete envoye, il devient le niveau de base lorsque la fence du PBO est signalee
+struct Completion
+{
+	uint32_t texture;
+	uint32_t level;
+};
+
+struct PixelBuffer
+{
+	uint32_t id;
+	uint8_t* mapped;	// projection permanente, nullptr si le PBO est orphelin a chaque remplissage
+	GLsync fence;		// 0 si le GPU n'utilise plus le PBO
+	std::vector<Completion> completions;
+};
+
+static TextureStreamer::Options streamOptions;
+static TextureStreamer::Statistics statistics;
+static std::vector<Job> queue;				// dans l'ordre d'arrivee, departage les priorites egales
+static std::unordered_map<uint32_t, float> requests;	// demandes de la frame en cours (cf. Request)
+static std::vector<PixelBuffer> buffers;
+static std::vector<Chunk> chunks;
+static uint32_t currentBuffer = 0;
+
+// geometrie d'un niveau vue comme une suite de lignes : 1 pixel de haut en RGBA8, 4 pixels (une ligne de blocs) sinon
+static void LevelRows(const TextureCache::Image& image, uint32_t level, uint32_t* rowCount, uint32_t* rowHeight, uint32_t* rowBytes)
+{
+	const uint32_t height = std::max(1u, image.height >> level);
+	*rowHeight = (image.format == TextureCache::FORMAT_RGBA8) ? 1 : 4;
+	*rowCount = (height + *rowHeight - 1) / *rowHeight;
+	*rowBytes = image.levelSizes[level] / *rowCount;
+}
+
+static void CompleteLevel(const Completion& completion)
+{
+	GLState::BindTexture(0, GL_TEXTURE_2D, completion.texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, completion.level);
+}
+
+// priorite d'une texture : sa taille a l'ecran tant que le niveau en cours est utile a cette taille
+// (au moins un texel par pixel), 0 sinon. Les textures de priorite nulle sont envoyees en arriere plan
+static float Priority(const Job& job)
+{
+	if (job.pixelSize <= 0.f)
+		return 0.f;
+	const uint32_t size = std::max(job.image.width, job.image.height) >> job.level;
+	return (float(size) * 0.5f < job.pixelSize) ? job.pixelSize : 0.f;
+}
+
+namespace TextureStreamer
+{
+	void Initialize(const Options& options)
+	{
+		streamOptions = options;
+		// une ligne d'un niveau doit tenir dans un PBO (16384 pixels RGBA8)
+		streamOptions.bytesPerFrame = std::max(streamOptions.bytesPerFrame, 16384u * 4u);
+		streamOptions.bufferCount = std::max(streamOptions.bufferCount, 1u);
+		memset(&statistics, 0, sizeof(Statistics));
+
+		// GL_ARB_buffer_storage (OpenGL 4.4) : projection permanente et coherente, aucun map/unmap par frame
+		const bool persistent = GLEW_ARB_buffer_storage != 0;
+		buffers.resize(streamOptions.bufferCount);
+		for (PixelBuffer& buffer : buffers)
+		{
+			glGenBuffers(1, &buffer.id);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+			buffer.mapped = nullptr;
+			buffer.fence = 0;
+			if (persistent) {
+				const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				glBufferStorage(GL_PIXEL_UNPACK_BUFFER, streamOptions.bytesPerFrame, nullptr, flags);
+				buffer.mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, streamOptions.bytesPerFrame, flags);
+			}
+			else
+				glBufferData(GL_PIXEL_UNPACK_BUFFER, streamOptions.bytesPerFrame, nullptr, GL_STREAM_DRAW);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		currentBuffer = 0;
+	}
+
+	bool IsInitialized()
+	{
+		return !buffers.empty();
+	}
+
+	uint32_t Enqueue(TextureCache::Image&& image)
+	{
+		// tous les niveaux sont alloues (contenu indefini), la queue de mipmaps est assez petite pour etre envoyee tout de suite
+		uint32_t tail = 0;
+		while (tail < image.levelCount - 1 && std::max(image.width, image.height) >> tail > streamOptions.tailSize)
+			tail++;
+		const void* levels[TextureCache::MAX_LEVEL_COUNT] = {};
+		for (uint32_t level = tail; level < image.levelCount; level++)
+			levels[level] = image.Level(level);
+		uint32_t textureID = CreateTexture(image.Desc(), levels);
+		if (tail == 0)
+			return textureID;
+
+		// seule la queue est echantillonnee en attendant les niveaux plus fins
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, tail);
+		Job job;
+		job.texture = textureID;
+		job.image = std::move(image);
+		job.level = tail - 1;
+		job.row = 0;
+		job.pixelSize = 0.f;
+		queue.push_back(std::move(job));
+		++statistics.pendingTextures;
+		return textureID;
+	}
+
+	void Update()
+	{
+		statistics.bytesLastFrame = 0;
+
+		// les niveaux dont les envois ont ete executes par le GPU deviennent echantillonnables
+		// dans l'ordre de remplissage des PBO (du plus ancien, buffers[currentBuffer], au plus recent) : deux PBO peuvent
+		// contenir des niveaux d'une meme texture, GL_TEXTURE_BASE_LEVEL ne doit jamais remonter vers un niveau plus grossier
+		for (uint32_t k = 0; k < uint32_t(buffers.size()); k++)
+		{
+			PixelBuffer& buffer = buffers[(currentBuffer + k) % buffers.size()];
+			if (buffer.fence == 0)
+				continue;
+			// les fences sont signalees dans l'ordre, les PBO suivants attendront la frame suivante
+			if (glClientWaitSync(buffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+				break;
+			glDeleteSync(buffer.fence);
+			buffer.fence = 0;
+			for (const Completion& completion : buffer.completions) {
+				CompleteLevel(completion);
+				if (completion.level == 0)
+					--statistics.pendingTextures;
+			}
+			buffer.completions.clear();
+		}
+
+		// les demandes de la frame precedente fixent les priorites de celle-ci
+		for (Job& job : queue) {
+			auto request = requests.find(job.texture);
+			job.pixelSize = (request != requests.end()) ? request->second : 0.f;
+		}
+		requests.clear();
+		if (queue.empty())
+			return;
+
+		// le GPU lit encore le PBO suivant : on n'attend pas, l'envoi reprendra a la frame suivante
+		PixelBuffer& buffer = buffers[currentBuffer];
+		if (buffer.fence != 0) {
+			++statistics.stalledFrames;
+			return;
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+		uint8_t* destination = buffer.mapped;
+		if (destination == nullptr) {
+			// orphelin : le driver fournit un nouveau stockage si l'ancien est encore utilise
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, streamOptions.bytesPerFrame, nullptr, GL_STREAM_DRAW);
+			destination = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, streamOptions.bytesPerFrame,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			if (destination == nullptr) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				return;
+			}
+		}
+
+		// remplissage dans la limite du budget, un niveau trop gros est decoupe en groupes de lignes
+		chunks.clear();
+		uint32_t used = 0;
+		while (!queue.empty())
+		{
+			// texture la plus prioritaire, la plus ancienne a priorite egale
+			size_t best = 0;
+			float bestPriority = Priority(queue[0]);
+			for (size_t i = 1; i < queue.size(); i++) {
+				const float priority = Priority(queue[i]);
+				if (priority > bestPriority) {
+					best = i;
+					bestPriority = priority;
+				}
+			}
+			Job& job = queue[best];
+			uint32_t rowCount, rowHeight, rowBytes;
+			LevelRows(job.image, job.level, &rowCount, &rowHeight, &rowBytes);
+			const uint32_t rows = std::min(rowCount - job.row, (streamOptions.bytesPerFrame - used) / rowBytes);
+			if (rows == 0)
+				break;
+
+			Chunk chunk;
+			chunk.texture = job.texture;
+			chunk.internalFormat = job.image.InternalFormat();
+			chunk.level = job.level;
+			chunk.y = job.row * rowHeight;
+			chunk.width = std::max(1u, job.image.width >> job.level);
+			chunk.height = std::min(rows * rowHeight, std::max(1u, job.image.height >> job.level) - chunk.y);
+			chunk.offset = used;
+			chunk.size = rows * rowBytes;
+			memcpy(destination + used, job.image.Level(job.level) + size_t(job.row) * rowBytes, chunk.size);
+			chunks.push_back(chunk);
+			used = std::min(streamOptions.bytesPerFrame, (used + chunk.size + CHUNK_ALIGNMENT - 1) & ~(CHUNK_ALIGNMENT - 1));
+
+			job.row += rows;
+			if (job.row < rowCount)
+				continue;
+			buffer.completions.push_back({ job.texture, job.level });
+			job.row = 0;
+			if (job.level == 0)
+				queue.erase(queue.begin() + best);
+			else
+				--job.level;
+		}
+		if (buffer.mapped == nullptr)
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		// avec un PBO lie, le pointeur des donnees est un offset dans le PBO
+		for (const Chunk& chunk : chunks)
+		{
+			GLState::BindTexture(0, GL_TEXTURE_2D, chunk.texture);
+			if (!IsCompressedFormat(chunk.internalFormat))
+				glTexSubImage2D(GL_TEXTURE_2D, chunk.level, 0, chunk.y, chunk.width, chunk.height, GL_RGBA, GL_UNSIGNED_BYTE,
+					(void*)(uintptr_t)chunk.offset);
+			else
+				glCompressedTexSubImage2D(GL_TEXTURE_2D, chunk.level, 0, chunk.y, chunk.width, chunk.height, chunk.internalFormat,
+					chunk.size, (void*)(uintptr_t)chunk.offset);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		currentBuffer = (currentBuffer + 1) % uint32_t(buffers.size());
+
+		statistics.bytesLastFrame = used;
+		statistics.bytesTotal += used;
+	}
+
+	void Request(uint32_t textureID, float pixelSize)
+	{
+		if (queue.empty())
+			return;
+		float& request = requests[textureID];
+		request = std::max(request, pixelSize);
+	}
+
+	void Cancel(uint32_t textureID)
+	{
+		bool pending = false;
+		auto job = std::find_if(queue.begin(), queue.end(), [textureID](const Job& j) { return j.texture == textureID; });
+		if (job != queue.end()) {
+			queue.erase(job);
+			pending = true;
+		}
+		// l'identifiant pourrait etre reutilise par une nouvelle texture avant que la fence soit signalee
+		for (PixelBuffer& buffer : buffers)
+		{
+			auto last = std::remove_if(buffer.completions.begin(), buffer.completions.end(),
+				[textureID, &pending](const Completion& completion) {
+					if (completion.texture != textureID)
+						return false;
+					pending |= (completion.level == 0);
+					return true;
+				});
+			buffer.completions.erase(last, buffer.completions.end());
+		}
+		if (pending)
+			--statistics.pendingTextures;
+	}
+
+	void Shutdown()
+	{
+		for (PixelBuffer& buffer : buffers)
+		{
+			if (buffer.fence != 0)
+				glDeleteSync(buffer.fence);
+			if (buffer.mapped != nullptr) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			}
+			glDeleteBuffers(1, &buffer.id);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		std::vector<PixelBuffer>().swap(buffers);
+		std::vector<Job>().swap(queue);
+		requests.clear();
+		std::vector<Chunk>().swap(chunks);
+		statistics.pendingTextures = 0;
+	}
+
+	const Statistics& GetStatistics()
+	{
+		return statistics;
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+#include "TextureCache.h"
+
+// Envoi asynchrone des textures au GPU par pixel buffer objects (PBO)
+// glTexImage2D depuis la memoire du programme est synchrone : le driver copie toute l'image avant de rendre la main,
+// la boucle de rendu est bloquee lorsqu'un lot de textures arrive. Ici les niveaux de mipmap sont copies dans un anneau
+// de PBO (projetes en permanence si GL_ARB_buffer_storage est disponible, sinon "orphelins" a chaque remplissage)
+// et glTexSubImage2D lit depuis le PBO, la copie vers la memoire video est faite par le GPU.
+// Update() copie au plus bytesPerFrame octets par frame, un PBO n'est reutilise qu'une fois sa fence signalee.
+//
+// Residence progressive : Enqueue() envoie immediatement la queue de mipmaps (niveaux d'au plus tailSize pixels),
+// les niveaux plus fins suivent du plus grossier au plus fin. GL_TEXTURE_BASE_LEVEL est abaisse a chaque niveau
+// recu, l'identifiant de la texture (Material::diffuseTexture) reste donc valide et utilisable pendant tout l'envoi.
+// Les textures les plus grandes a l'ecran (cf. Request) passent en premier, les autres suivent en arriere plan.
+// Une image lue depuis le cache .btex reste projetee (cf. TextureCache::Load) : ses niveaux fins ne sont lus sur le disque
+// qu'au moment de leur copie dans un PBO, le chargement de la scene ne lit que les en-tetes et la queue de mipmaps.
+namespace TextureStreamer
+{
+	struct Options
+	{
+		uint32_t bytesPerFrame;	// budget d'envoi d'une frame, c'est aussi la taille de chaque PBO
+		uint32_t bufferCount;	// nombre de PBO de l'anneau (frames en vol)
+		uint32_t tailSize;		// les niveaux dont la plus grande dimension ne depasse pas tailSize sont envoyes par Enqueue
+
+		Options() : bytesPerFrame(4 << 20), bufferCount(3), tailSize(32) {}
+	};
+
+	struct Statistics
+	{
+		uint32_t pendingTextures;	// textures dont l'envoi n'est pas termine (fence comprise)
+		uint32_t bytesLastFrame;	// octets copies lors du dernier Update()
+		uint64_t bytesTotal;
+		uint32_t stalledFrames;		// frames sans envoi, le PBO suivant etant encore lu par le GPU
+	};
+
+	void Initialize(const Options& options = Options());
+	bool IsInitialized();
+	// cree la texture (tous les niveaux alloues, seule la queue de mipmaps est envoyee immediatement) et la place dans la file
+	// les donnees de image sont conservees jusqu'a ce qu'elles soient copiees dans un PBO
+	uint32_t Enqueue(TextureCache::Image&& image);
+	// une fois par frame, sur le thread du contexte GL
+	void Update();
+	// pixelSize : taille a l'ecran (en pixels) d'une surface dessinee avec la texture pendant la frame
+	// seuls les niveaux dont la resolution est utile a cette taille sont prioritaires, le plus grand pixelSize l'emporte
+	void Request(uint32_t textureID, float pixelSize);
+	// a appeler avant glDeleteTextures si l'envoi de la texture n'est peut-etre pas termine
+	void Cancel(uint32_t textureID);
+	// abandonne les envois en cours et detruit les PBO
+	void Shutdown();
+	const Statistics& GetStatistics();
+}
@@ -32,3 +32,18 @@ struct Vertex
 	}
 };
 
+// format de sommet choisi au chargement (cf. Mesh::ParseOptions::vertexFormat)
+enum VertexFormat
+{
+	VERTEX_FLOAT,		// Vertex, 36 octets
+	VERTEX_PACKED		// PackedVertex, 20 octets
+};
+
+// sommet compact (quantifie), decode par le "vertex fetch" grace aux formats de glVertexAttribPointer
+struct PackedVertex
+{
+	uint16_t position[4];	//  4x2 octets = 8, unorm16 relatif a la boite englobante du SubMesh (w inutilise)
+	uint32_t normal;		// +4 octets = 12, snorm 10-10-10-2 (GL_INT_2_10_10_10_REV)
+	uint16_t texcoords[2];	// +2x2 octets = 16, half float (GL_HALF_FLOAT), les uv peuvent sortir de [0;1]
+	uint8_t color[4];		// +4 octets = 20, RGBA8
+};
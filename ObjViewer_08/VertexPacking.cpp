@@ -0,0 +1,150 @@
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+
+uint16_t FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(float));
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	const int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if (((bits >> 23) & 0xff) == 0xff)		// infini ou NaN
+		return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	if (exponent >= 31)						// trop grand : infini
+		return uint16_t(sign | 0x7c00);
+	if (exponent <= 0)
+	{
+		// denormalise (ou zero)
+		if (exponent < -10)
+			return uint16_t(sign);
+		mantissa |= 0x800000;
+		const uint32_t shift = uint32_t(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		// arrondi au plus proche
+		if ((mantissa >> (shift - 1)) & 1)
+			half++;
+		return uint16_t(sign | half);
+	}
+	uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+	// arrondi au plus proche, la retenue peut incrementer l'exposant ce qui reste correct
+	if (mantissa & 0x1000)
+		half++;
+	return uint16_t(half);
+}
+
+float HalfToFloat(uint16_t value)
+{
+	const uint32_t sign = uint32_t(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1f;
+	uint32_t mantissa = value & 0x3ff;
+	uint32_t bits;
+	if (exponent == 0x1f)
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	else if (exponent == 0)
+	{
+		if (mantissa == 0)
+			bits = sign;
+		else {
+			// denormalise : on normalise la mantisse
+			exponent = 1;
+			while ((mantissa & 0x400) == 0) {
+				mantissa <<= 1;
+				exponent--;
+			}
+			mantissa &= 0x3ff;
+			bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+		}
+	}
+	else
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	float result;
+	memcpy(&result, &bits, sizeof(float));
+	return result;
+}
+
+QuantizationBounds ComputeQuantizationBounds(const Vertex* vertices, size_t vertexCount)
+{
+	QuantizationBounds bounds = { { 0.f, 0.f, 0.f }, { 1.f, 1.f, 1.f } };
+	if (vertexCount == 0)
+		return bounds;
+	vec3 minimum = vertices[0].position, maximum = minimum;
+	for (size_t i = 1; i < vertexCount; i++) {
+		const vec3& p = vertices[i].position;
+		minimum = { std::min(minimum.x, p.x), std::min(minimum.y, p.y), std::min(minimum.z, p.z) };
+		maximum = { std::max(maximum.x, p.x), std::max(maximum.y, p.y), std::max(maximum.z, p.z) };
+	}
+	bounds.offset = minimum;
+	bounds.scale = { maximum.x - minimum.x, maximum.y - minimum.y, maximum.z - minimum.z };
+	return bounds;
+}
+
+static inline uint16_t QuantizeUnorm16(float value, float offset, float scale)
+{
+	if (scale <= 0.f)
+		return 0;
+	const float normalized = std::min(std::max((value - offset) / scale, 0.f), 1.f);
+	return uint16_t(normalized * 65535.f + 0.5f);
+}
+
+// composante snorm 10 bits, decodage GL 4.2+ : max(c / 511, -1)
+static inline uint32_t QuantizeSnorm10(float value)
+{
+	const float clamped = std::min(std::max(value, -1.f), 1.f);
+	const int32_t q = int32_t(floorf(clamped * 511.f + 0.5f));
+	return uint32_t(q) & 0x3ff;
+}
+
+static inline float DecodeSnorm10(uint32_t bits)
+{
+	int32_t q = int32_t(bits & 0x3ff);
+	if (q & 0x200)
+		q -= 0x400;
+	return std::max(float(q) / 511.f, -1.f);
+}
+
+void PackVertices(PackedVertex* destination, const Vertex* vertices, size_t vertexCount, const QuantizationBounds& bounds,
+	QuantizationError* error)
+{
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const Vertex& v = vertices[i];
+		PackedVertex& packed = destination[i];
+
+		packed.position[0] = QuantizeUnorm16(v.position.x, bounds.offset.x, bounds.scale.x);
+		packed.position[1] = QuantizeUnorm16(v.position.y, bounds.offset.y, bounds.scale.y);
+		packed.position[2] = QuantizeUnorm16(v.position.z, bounds.offset.z, bounds.scale.z);
+		packed.position[3] = 0;
+
+		// la normale est normalisee avant quantification, les normales nulles (non definies) restent nulles
+		vec3 n = v.normal;
+		const float length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+		if (length > 0.f)
+			n = { n.x / length, n.y / length, n.z / length };
+		packed.normal = QuantizeSnorm10(n.x) | (QuantizeSnorm10(n.y) << 10) | (QuantizeSnorm10(n.z) << 20);
+
+		packed.texcoords[0] = FloatToHalf(v.texcoords.x);
+		packed.texcoords[1] = FloatToHalf(v.texcoords.y);
+		memcpy(packed.color, v.color, sizeof(packed.color));
+
+		if (error == nullptr)
+			continue;
+
+		// decodage identique a celui du GPU afin de mesurer les ecarts
+		for (int k = 0; k < 3; k++) {
+			const float offset = (&bounds.offset.x)[k], scale = (&bounds.scale.x)[k];
+			const float decoded = offset + scale * (float(packed.position[k]) / 65535.f);
+			error->position = std::max(error->position, fabsf(decoded - (&v.position.x)[k]));
+		}
+		if (length > 0.f) {
+			const vec3 d = { DecodeSnorm10(packed.normal), DecodeSnorm10(packed.normal >> 10), DecodeSnorm10(packed.normal >> 20) };
+			const float dl = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+			const float cosAngle = std::min(1.f, (d.x * n.x + d.y * n.y + d.z * n.z) / dl);
+			error->normalDegrees = std::max(error->normalDegrees, acosf(cosAngle) * float(180.0 / M_PI));
+		}
+		error->texcoords = std::max(error->texcoords, fabsf(HalfToFloat(packed.texcoords[0]) - v.texcoords.x));
+		error->texcoords = std::max(error->texcoords, fabsf(HalfToFloat(packed.texcoords[1]) - v.texcoords.y));
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "Vertex.h"
+
+// Quantification des sommets (Vertex -> PackedVertex)
+// la position est exprimee dans la boite englobante du SubMesh : p = offset + scale * unorm16
+// offset et scale sont transmis au vertex shader (u_PositionOffset, u_PositionScale)
+
+struct QuantizationBounds
+{
+	vec3 offset;	// coin minimum de la boite englobante
+	vec3 scale;		// dimensions de la boite englobante
+};
+
+// erreurs maximales constatees apres decodage
+struct QuantizationError
+{
+	float position;			// en unites du modele
+	float normalDegrees;	// ecart angulaire des normales
+	float texcoords;
+
+	QuantizationError() : position(0.f), normalDegrees(0.f), texcoords(0.f) {}
+};
+
+QuantizationBounds ComputeQuantizationBounds(const Vertex* vertices, size_t vertexCount);
+
+// error (optionnel) est mis a jour avec les ecarts maximums
+void PackVertices(PackedVertex* destination, const Vertex* vertices, size_t vertexCount, const QuantizationBounds& bounds,
+	QuantizationError* error = nullptr);
+
+// conversions float <-> half float (IEEE 754 binaire 16 bits), arrondi au plus proche
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
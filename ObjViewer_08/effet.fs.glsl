@@ -1,6 +1,17 @@
 #version 120
+#extension GL_ARB_uniform_buffer_object : require
+
+// meme bloc que opaque.vs.glsl, seul u_Time est utilise ici
+layout(std140) uniform FrameData
+{
+	mat4 u_ViewMatrix;
+	mat4 u_ProjectionMatrix;
+	vec3 u_CameraPosition;
+	float u_Time;
+	vec4 u_LightDirections[2];	// directions normalisees vers les lumieres, w inutilise
+	vec4 u_LightColors[2];
+};
 
-uniform float u_Time;
 uniform sampler2D u_Texture;
 
 varying vec2 v_UV;
@@ -1,21 +1,59 @@
 #version 120
+#extension GL_EXT_texture_array : enable
+#extension GL_ARB_uniform_buffer_object : require
 
 varying vec3 v_Position;
 varying vec3 v_Normal;
 varying vec2 v_TexCoords;
 varying vec3 v_Color;		// vertex color, suppose une valeur par defaut de (1, 1, 1) sans alpha
+varying float v_MaterialIndex;
 
+// donnees communes a tous les programmes, ecrites une seule fois par frame (cf. FrameData dans ObjViewer_PostProcess.cpp)
+// la declaration doit etre identique dans tous les shaders qui l'utilisent
+layout(std140) uniform FrameData
+{
+	mat4 u_ViewMatrix;
+	mat4 u_ProjectionMatrix;
+	vec3 u_CameraPosition;
+	float u_Time;
+	vec4 u_LightDirections[2];	// directions normalisees vers les lumieres, w inutilise
+	vec4 u_LightColors[2];
+};
+
+// meme disposition que MaterialBlock (Material.h)
 struct Material {
 	vec3 AmbientColor;
+	float Shininess;
 	vec3 DiffuseColor;
+	float DiffuseLayer;		// couche de u_DiffuseArrays[DiffuseArray]
 	vec3 SpecularColor;
-	float Shininess;
+	int DiffuseArray;		// -1 : u_DiffuseTexture
+};
+// materiaux du Mesh (cf. Mesh::UploadMaterials), v_MaterialIndex designe celui du SubMesh
+layout(std140) uniform MaterialData
+{
+	Material u_Materials[256];
 };
-uniform Material u_Material;
-
-uniform vec3 u_CameraPosition;
 
 uniform sampler2D u_DiffuseTexture;
+// textures regroupees par format et dimensions (cf. TextureArray.h), liees aux unites 1 a 8
+// GLSL 1.20 n'indexe un tableau de samplers qu'avec une constante, d'ou la suite de tests dans DiffuseTexel
+uniform sampler2DArray u_DiffuseArrays[8];
+
+// le materiau est le meme pour tout le SubMesh, le branchement ne diverge pas au sein d'un triangle
+vec4 DiffuseTexel(Material material, vec2 uv)
+{
+	vec3 coords = vec3(uv, material.DiffuseLayer);
+	if (material.DiffuseArray == 0) return texture2DArray(u_DiffuseArrays[0], coords);
+	if (material.DiffuseArray == 1) return texture2DArray(u_DiffuseArrays[1], coords);
+	if (material.DiffuseArray == 2) return texture2DArray(u_DiffuseArrays[2], coords);
+	if (material.DiffuseArray == 3) return texture2DArray(u_DiffuseArrays[3], coords);
+	if (material.DiffuseArray == 4) return texture2DArray(u_DiffuseArrays[4], coords);
+	if (material.DiffuseArray == 5) return texture2DArray(u_DiffuseArrays[5], coords);
+	if (material.DiffuseArray == 6) return texture2DArray(u_DiffuseArrays[6], coords);
+	if (material.DiffuseArray == 7) return texture2DArray(u_DiffuseArrays[7], coords);
+	return texture2D(u_DiffuseTexture, uv);
+}
 
 // calcul du facteur diffus, suivant la loi du cosinus de Lambert
 float Lambert(vec3 N, vec3 L)
@@ -42,33 +80,33 @@ float BlinnPhong(vec3 N, vec3 L, vec3 V, float shininess)
 
 void main(void)
 {
-	// directions des deux lumieres (fixes)
-	const vec3 L[2] = vec3[2](normalize(vec3(-1.0, 1.0, 1.0)), normalize(vec3(1.0, 1.0, 1.0)));
-	const vec3 lightColor[2] = vec3[2](vec3(1.0, 1.0, 0.0), vec3(0.0, 1.0, 1.0));
+	// la valeur interpolee d'une constante peut s'en ecarter legerement
+	Material material = u_Materials[int(v_MaterialIndex + 0.5)];
 	const float attenuation = 1.0; // on suppose une attenuation faible ici
 	// theoriquement, l'attenuation naturelle est proche de 1 / distance
 
 	vec3 N = normalize(v_Normal);
 	vec3 V = normalize(u_CameraPosition - v_Position);
 
-	vec4 baseTexel = texture2D(u_DiffuseTexture, v_TexCoords);
-	// decompression gamma, les couleurs des texels ont ete specifies dans l'espace colorimetrique
-	// du moniteur (en sRGB) il faut donc convertir en RGB lineaire pour que les maths soient corrects
-	baseTexel.rgb = pow(baseTexel.rgb, vec3(2.2));
+	// les couleurs des texels ont ete specifiees dans l'espace colorimetrique du moniteur (sRGB)
+	// les textures utilisent un format interne SRGB, le GPU les convertit en RGB lineaire avant le filtrage
+	vec4 baseTexel = DiffuseTexel(material, v_TexCoords);
 	vec3 baseColor = baseTexel.rgb * v_Color.rgb;
 
 	vec3 directColor = vec3(0.0);
 	for (int i = 0; i < 2; i++)
 	{
 		// les couleurs diffuse et speculaire traduisent l'illumination directe de l'objet
-		vec3 diffuseColor = baseColor * u_Material.DiffuseColor * Lambert(N, L[i]);
-		vec3 specularColor = u_Material.SpecularColor * Phong(N, L[i], V, u_Material.Shininess);
+		// les deux lumieres directionnelles sont decrites dans FrameData
+		vec3 L = u_LightDirections[i].xyz;
+		vec3 diffuseColor = baseColor * material.DiffuseColor * Lambert(N, L);
+		vec3 specularColor = material.SpecularColor * Phong(N, L, V, material.Shininess);
 
-		directColor += (diffuseColor + specularColor) * lightColor[i] * attenuation;
+		directColor += (diffuseColor + specularColor) * u_LightColors[i].rgb * attenuation;
 	}
 
 	// la couleur ambiante traduit une approximation de l'illumination indirecte de l'objet
-	vec3 ambientColor = baseColor * u_Material.AmbientColor;
+	vec3 ambientColor = baseColor * material.AmbientColor;
 	vec3 indirectColor = ambientColor;
 
 	vec3 color = directColor + indirectColor;
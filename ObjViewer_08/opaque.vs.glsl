@@ -1,18 +1,49 @@
 #version 120
+#extension GL_ARB_uniform_buffer_object : require
 
 attribute vec3 a_Position;
 attribute vec3 a_Normal;
 attribute vec2 a_TexCoords;
 attribute vec3 a_Color;		// vertex color, suppose une valeur par defaut de (1, 1, 1) sans alpha
 
+// donnees communes a tous les programmes, ecrites une seule fois par frame (cf. FrameData dans ObjViewer_PostProcess.cpp)
+// la declaration doit etre identique dans tous les shaders qui l'utilisent
+layout(std140) uniform FrameData
+{
+	mat4 u_ViewMatrix;
+	mat4 u_ProjectionMatrix;
+	vec3 u_CameraPosition;
+	float u_Time;
+	vec4 u_LightDirections[2];	// directions normalisees vers les lumieres, w inutilise
+	vec4 u_LightColors[2];
+};
+
+// propre a chaque objet (rotation de la scene), appliquee apres la transformation de l'instance
 uniform mat4 u_WorldMatrix;
-uniform mat4 u_ViewMatrix;
-uniform mat4 u_ProjectionMatrix;
+
+// transformation propre a chaque instance (cf. InstanceTransform dans ObjViewer_PostProcess.cpp)
+// les trois premieres lignes d'une matrice 4x3, la derniere ligne vaut toujours (0, 0, 0, 1)
+// en rendu instancie ce sont des attributs d'instance (glVertexAttribDivisor = 1), sinon l'identite fixee par glVertexAttrib4f
+// on suppose que la transformation est une rotation, une translation et une echelle uniforme (normales non deformees)
+attribute vec4 a_InstanceRow0;
+attribute vec4 a_InstanceRow1;
+attribute vec4 a_InstanceRow2;
+
+// donnees propres au SubMesh (cf. DrawData dans ObjViewer_PostProcess.cpp)
+// en rendu indirect ce sont des attributs d'instance (baseInstance = indice du SubMesh), sinon des valeurs constantes
+// fixees par glVertexAttrib* avant chaque draw call
+// dequantification des positions (sommets compacts, cf. PackedVertex)
+// a_Position est alors dans [0;1] relativement a la boite englobante du SubMesh
+// offset = 0 et scale = 1 pour des positions en float
+attribute vec3 a_PositionOffset;
+attribute vec3 a_PositionScale;
+attribute float a_MaterialIndex;		// indice dans u_Materials (cf. opaque.fs.glsl)
 
 varying vec3 v_Position;
 varying vec3 v_Normal;
 varying vec2 v_TexCoords;
 varying vec3 v_Color; 		// vertex color, suppose une valeur par defaut de (1, 1, 1) sans alpha
+varying float v_MaterialIndex;	// identique pour tous les sommets d'un SubMesh (pas de "flat" en GLSL 1.20)
 
 void main(void)
 {
@@ -20,14 +51,24 @@ void main(void)
 
 	// approx. decompression gamma, les couleurs des vertices ont ete saisies dans l'espace colorimetrique
 	// du moniteur (en sRGB) il faut donc convertir en RGB lineaire pour que les maths soient corrects
+	// elles sont stockees en sRGB sur 8 bits (cf. Mesh::ParseObj), en lineaire les teintes sombres seraient perdues
 	v_Color = pow(a_Color, vec3(2.2));
 
-	v_Position = vec3(u_WorldMatrix * vec4(a_Position, 1.0));
+	v_MaterialIndex = a_MaterialIndex;
+
+	vec3 position = a_PositionOffset + a_PositionScale * a_Position;
+
+	// placement de l'instance, produit ligne par ligne (pas de construction de mat4 par lignes en GLSL)
+	vec4 localPosition = vec4(position, 1.0);
+	vec4 instancePosition = vec4(dot(a_InstanceRow0, localPosition), dot(a_InstanceRow1, localPosition), dot(a_InstanceRow2, localPosition), 1.0);
+	vec3 instanceNormal = vec3(dot(a_InstanceRow0.xyz, a_Normal), dot(a_InstanceRow1.xyz, a_Normal), dot(a_InstanceRow2.xyz, a_Normal));
+
+	v_Position = vec3(u_WorldMatrix * instancePosition);
 	// note: techniquement il faudrait passer une normal matrix du C++ vers le GLSL
 	// pour les raisons que l'on a vu en cours. A defaut on pourrait la calculer ici
 	// mais les fonctions inverse() et transpose() n'existe pas dans toutes les versions d'OpenGL
 	// on suppose ici que la matrice monde -celle appliquee a v_Position- est orthogonale (sans deformation des axes)
-	v_Normal = mat3(u_WorldMatrix) * a_Normal;
+	v_Normal = mat3(u_WorldMatrix) * instanceNormal;
 
-	gl_Position = u_ProjectionMatrix * u_ViewMatrix * u_WorldMatrix * vec4(a_Position, 1.0);
+	gl_Position = u_ProjectionMatrix * u_ViewMatrix * u_WorldMatrix * instancePosition;
 }
\ No newline at end of file
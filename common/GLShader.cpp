@@ -3,6 +3,7 @@
 #include "../common/GLShader.h"
 #include "GL/glew.h"
 
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
@@ -145,9 +146,182 @@ bool GLShader::Create()
 		return false;
 	}
 
+	// les locations ne changent plus jusqu'a la prochaine edition de liens
+	Reflect();
+
+	return true;
+}
+
+// taille en octets d'une valeur du type donne, les tableaux sont decomposes element par element
+static uint32_t UniformSize(GLenum type)
+{
+	switch (type)
+	{
+	case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_BOOL_VEC2:
+		return 2 * sizeof(float);
+	case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_BOOL_VEC3:
+		return 3 * sizeof(float);
+	case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_BOOL_VEC4: case GL_FLOAT_MAT2:
+		return 4 * sizeof(float);
+	case GL_FLOAT_MAT3:
+		return 9 * sizeof(float);
+	case GL_FLOAT_MAT4:
+		return 16 * sizeof(float);
+	default:
+		// float, int, bool et samplers. Les matrices non carrees ne sont pas memorisees (cf. IsRedundant)
+		return sizeof(float);
+	}
+}
+
+void GLShader::Reflect()
+{
+	ClearReflection();
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(m_Program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(m_Program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength + 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint arraySize = 0;
+		GLenum type = 0;
+		GLsizei length = 0;
+		glGetActiveUniform(m_Program, i, GLsizei(name.size()), &length, &arraySize, &type, name.data());
+		std::string baseName(name.data(), length);
+		// un tableau est nomme d'apres son premier element ("u_DiffuseArrays[0]")
+		const bool isArray = (length > 3 && baseName.compare(length - 3, 3, "[0]") == 0);
+		if (isArray)
+			baseName.resize(length - 3);
+
+		for (GLint element = 0; element < arraySize; element++)
+		{
+			const std::string elementName = isArray ? baseName + "[" + std::to_string(element) + "]" : baseName;
+			// -1 pour les membres des uniform blocks, qui ne sont pas envoyes par glUniform*
+			const GLint location = glGetUniformLocation(m_Program, elementName.c_str());
+			if (location < 0)
+				continue;
+			m_UniformLocations[elementName] = location;
+			if (element == 0)
+				m_UniformLocations[baseName] = location;
+
+			if (uint32_t(location) >= m_UniformIndices.size())
+				m_UniformIndices.resize(location + 1, -1);
+			m_UniformIndices[location] = int32_t(m_Uniforms.size());
+			const Uniform uniform = { type, UniformSize(type), uint32_t(m_UniformValues.size()), false };
+			m_Uniforms.push_back(uniform);
+			m_UniformValues.resize(m_UniformValues.size() + uniform.size);
+		}
+	}
+
+	glGetProgramiv(m_Program, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(m_Program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+	name.resize(maxLength + 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint arraySize = 0;
+		GLenum type = 0;
+		GLsizei length = 0;
+		glGetActiveAttrib(m_Program, i, GLsizei(name.size()), &length, &arraySize, &type, name.data());
+		// -1 pour les attributs predefinis (gl_Vertex...)
+		const GLint location = glGetAttribLocation(m_Program, name.data());
+		if (location >= 0)
+			m_AttributeLocations[std::string(name.data(), length)] = location;
+	}
+}
+
+void GLShader::ClearReflection()
+{
+	m_UniformLocations.clear();
+	m_AttributeLocations.clear();
+	m_UniformIndices.clear();
+	m_Uniforms.clear();
+	m_UniformValues.clear();
+}
+
+int32_t GLShader::GetUniformLocation(const char* name) const
+{
+	auto it = m_UniformLocations.find(name);
+	return it != m_UniformLocations.end() ? it->second : -1;
+}
+
+int32_t GLShader::GetAttributeLocation(const char* name) const
+{
+	auto it = m_AttributeLocations.find(name);
+	return it != m_AttributeLocations.end() ? it->second : -1;
+}
+
+bool GLShader::BindUniformBlock(const char* name, uint32_t binding)
+{
+	const GLuint index = glGetUniformBlockIndex(m_Program, name);
+	if (index == GL_INVALID_INDEX)
+		return false;
+	glUniformBlockBinding(m_Program, index, binding);
 	return true;
 }
 
+bool GLShader::IsRedundant(int32_t location, const void* value, uint32_t size)
+{
+	if (uint32_t(location) >= m_UniformIndices.size() || m_UniformIndices[location] < 0)
+		return false;
+	Uniform& uniform = m_Uniforms[m_UniformIndices[location]];
+	if (size > uniform.size)
+		return false;
+	uint8_t* last = m_UniformValues.data() + uniform.offset;
+	if (uniform.uploaded && memcmp(last, value, size) == 0)
+		return true;
+	memcpy(last, value, size);
+	uniform.uploaded = true;
+	return false;
+}
+
+void GLShader::SetUniform(int32_t location, float value)
+{
+	if (location < 0)
+		return;
+	if (IsRedundant(location, &value, sizeof(value))) {
+		++m_RedundantUniforms;
+		return;
+	}
+	glUniform1f(location, value);
+	++m_UniformUploads;
+}
+
+void GLShader::SetUniform(int32_t location, int32_t value)
+{
+	if (location < 0)
+		return;
+	if (IsRedundant(location, &value, sizeof(value))) {
+		++m_RedundantUniforms;
+		return;
+	}
+	glUniform1i(location, value);
+	++m_UniformUploads;
+}
+
+void GLShader::SetUniform3(int32_t location, const float* value)
+{
+	if (location < 0)
+		return;
+	if (IsRedundant(location, value, 3 * sizeof(float))) {
+		++m_RedundantUniforms;
+		return;
+	}
+	glUniform3fv(location, 1, value);
+	++m_UniformUploads;
+}
+
+void GLShader::SetUniformMatrix4(int32_t location, const float* value)
+{
+	if (location < 0)
+		return;
+	if (IsRedundant(location, value, 16 * sizeof(float))) {
+		++m_RedundantUniforms;
+		return;
+	}
+	glUniformMatrix4fv(location, 1, false, value);
+	++m_UniformUploads;
+}
+
 void GLShader::Destroy()
 {
 	glDetachShader(m_Program, m_VertexShader);
@@ -157,5 +331,6 @@ void GLShader::Destroy()
 	glDeleteShader(m_VertexShader);
 	glDeleteShader(m_FragmentShader);
 	glDeleteProgram(m_Program);
+	ClearReflection();
 }
 
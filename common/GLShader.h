@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 class GLShader
 {
@@ -15,16 +18,58 @@ private:
 	// lors de la rasterization/remplissage de la primitive
 	uint32_t m_FragmentShader;
 
+	// uniforme actif releve apres l'edition de liens, avec une copie de la derniere valeur envoyee
+	struct Uniform
+	{
+		uint32_t type;			// GL_FLOAT_VEC3, GL_FLOAT_MAT4, GL_SAMPLER_2D...
+		uint32_t size;			// taille d'une valeur en octets
+		uint32_t offset;		// position de la derniere valeur dans m_UniformValues
+		bool uploaded;			// faux tant qu'aucune valeur n'a ete envoyee par les setters
+	};
+	// table nom -> location construite une seule fois (glGetActiveUniform / glGetActiveAttrib)
+	// les elements des tableaux ("u_Lights[2]") ont chacun leur entree, le premier aussi sous le nom du tableau
+	std::unordered_map<std::string, int32_t> m_UniformLocations;
+	std::unordered_map<std::string, int32_t> m_AttributeLocations;
+	std::vector<int32_t> m_UniformIndices;		// indice dans m_Uniforms de chaque location, -1 si inconnue
+	std::vector<Uniform> m_Uniforms;
+	std::vector<uint8_t> m_UniformValues;
+	uint32_t m_UniformUploads;
+	uint32_t m_RedundantUniforms;
+
 	bool CompileShader(uint32_t type);
+	void Reflect();
+	void ClearReflection();
+	// vrai si value est deja la valeur de l'uniforme, sinon la memorise
+	bool IsRedundant(int32_t location, const void* value, uint32_t size);
 public:
 	GLShader() : m_Program(0), m_VertexShader(0),
-		m_GeometryShader(0), m_FragmentShader(0) {
+		m_GeometryShader(0), m_FragmentShader(0),
+		m_UniformUploads(0), m_RedundantUniforms(0) {
 
 	}
 	~GLShader() {}
 
 	inline uint32_t GetProgram() { return m_Program; }
 
+	// -1 si le nom ne designe pas un uniforme ou un attribut actif (comme glGetUniformLocation)
+	// a appeler a l'initialisation et conserver le resultat : la recherche se fait sur une chaine
+	int32_t GetUniformLocation(const char* name) const;
+	int32_t GetAttributeLocation(const char* name) const;
+	// associe le uniform block name au point de liaison binding (cf. glBindBufferBase), false si le bloc est absent
+	bool BindUniformBlock(const char* name, uint32_t binding);
+
+	// envoi d'un uniforme du programme, qui doit etre actif (glUseProgram)
+	// la valeur est ignoree si elle est identique a la precedente, tant que l'uniforme n'est modifie que par ces setters
+	void SetUniform(int32_t location, float value);
+	void SetUniform(int32_t location, int32_t value);
+	void SetUniform3(int32_t location, const float* value);
+	void SetUniformMatrix4(int32_t location, const float* value);
+
+	// compteurs des setters depuis le dernier ResetUniformStatistics()
+	inline uint32_t GetUniformUploads() const { return m_UniformUploads; }
+	inline uint32_t GetRedundantUniforms() const { return m_RedundantUniforms; }
+	inline void ResetUniformStatistics() { m_UniformUploads = 0; m_RedundantUniforms = 0; }
+
 	bool LoadVertexShader(const char* filename);
 	bool LoadGeometryShader(const char* filename);
 	bool LoadFragmentShader(const char* filename);